@@ -72,7 +72,6 @@ Version history:
 #include <errno.h>
 #include <sys/ioctl.h>
 #include <sys/mtio.h>
-#include <regex.h>
 #include <grp.h>
 #include <pwd.h>
 #include "mtf.h"
@@ -84,28 +83,43 @@ typedef char* CHARPTR;
 char outPath[MAXPATHLEN + 1];
 char curPath[MAXPATHLEN + 1];
 char device[MAXPATHLEN + 1];
+char archivePath[MAXPATHLEN + 1];
+char catalogPath[MAXPATHLEN + 1];
+char seekPath[MAXPATHLEN + 1];
 int mtfd = -1;
-UINT8 verbose, debug, list, forceCase;
-UINT8 tBuffer[MAX_TAPE_BLOCK_SIZE];
-UINT16 setNum, matchCnt;
-UINT32 minFree;
+UINT8 verbose, debug, list, forceCase, asyncIO, preallocate, verify, globs;
+UINT8 setList;
+UINT8 tBuffer[TAPE_BUFFER_SIZE];
+UINT16 setNum, matchCnt, readAhead, workers;
+UINT32 minFree, resumeFree, checkInterval, readSize;
 size_t tapeBlockSize;
-regex_t match[MAX_PATTERN];
 gid_t group;
 uid_t owner;
 
+extern UINT8 tapeMapped;
+extern UINT16 mbcType;
+extern UINT32 listCnt;
+
 
 int main(int, char*[]);
 static CHARPTR* parseEnv(char*, int*);
 static INT16 parseArgs(int, char*[]);
 static INT16 whichSet(char*);
 static INT16 whichDevice(char*);
+static INT16 setArchive(char*);
+static INT16 setCatalog(char*);
+static INT16 setSeekCatalog(char*);
 static INT16 setBlockSize(char*);
+static INT16 setReadAhead(char*);
+static INT16 setReadSize(char*);
+static INT16 setWorkers(char*);
 static INT16 setPath(char*);
 static INT16 setOwner(char*);
 static INT16 setGroup(char*);
 static INT16 setCase(char*);
 static INT16 setMinFree(char*);
+static INT16 setCheckInterval(char*);
+static INT16 getBytes(char*, UINT32*);
 static INT16 getPatterns(int, char*[], int);
 static void usage(void);
 
@@ -124,11 +138,24 @@ int main(int argc, char *argv[])
 	verbose = 0;
 	debug = 0;
 	list = 0;
+	asyncIO = 0;
+	preallocate = 1;
+	verify = 0;
+	globs = 0;
+	setList = 0;
 	setNum = 0;
 	strcpy(outPath, "");
+	strcpy(archivePath, "");
+	strcpy(catalogPath, "");
+	strcpy(seekPath, "");
 	matchCnt = 0;
 	tapeBlockSize = 0;
+	readAhead = DEFAULT_READ_AHEAD;
+	readSize = 0;
+	workers = 0;
 	minFree = 0;
+	resumeFree = 0;
+	checkInterval = FREE_CHECK_INTERVAL;
 	owner = -1;
 	group = -1;
 	forceCase = CASE_SENSITIVE;
@@ -157,6 +184,38 @@ int main(int argc, char *argv[])
 		return(-1);
 	}
 
+	/* patterns may come from both MTF_OPTS and the command line */
+	if (compilePatterns() != 0)
+		return(-1);
+
+	if (archivePath[0] != '\0')
+	{
+		if (list != 0)
+		{
+			fprintf(stderr, "An archive (-a) cannot be written in list mode!\n");
+			return(-1);
+		}
+
+		if (openArchive(archivePath) != 0)
+			return(-1);
+	}
+
+	if (catalogPath[0] != '\0')
+	{
+		if (seekPath[0] != '\0')
+		{
+			fprintf(stderr, "A catalog cannot be written (-X) while seeking "
+			        "with one (-x)!\n");
+			return(-1);
+		}
+
+		if (openCatalog(catalogPath) != 0)
+			return(-1);
+	}
+
+	if ((seekPath[0] != '\0') && (loadCatalog(seekPath) != 0))
+		return(-1);
+
 	if (outPath[0] != '/')
 	{
 		getcwd(curPath, MAXPATHLEN);
@@ -183,6 +242,14 @@ int main(int argc, char *argv[])
 		
 		if (list > 0) fprintf(stdout, "List mode selected.\n");
 
+		if (asyncIO > 0) fprintf(stdout, "Asynchronous I/O selected.\n");
+
+		if (preallocate == 0)
+			fprintf(stdout, "Files will not be preallocated.\n");
+
+		if (verify != 0)
+			fprintf(stdout, "Checksums will be verified.\n");
+
 		if (forceCase == CASE_UPPER)
 			fprintf(stdout, "Case forced to upper.\n");
 		else if (forceCase == CASE_LOWER)
@@ -192,8 +259,24 @@ int main(int argc, char *argv[])
 			fprintf(stdout, "Tape block size set to %u bytes.\n",
 			        tapeBlockSize);
 
+		if (readAhead == 0)
+			fprintf(stdout, "Tape read-ahead disabled.\n");
+		else
+			fprintf(stdout, "Up to %u tape blocks will be read ahead.\n",
+			        readAhead);
+
+		if (readSize != 0)
+			fprintf(stdout, "Up to %lu bytes will be read at a time.\n",
+			        readSize);
+
+		if (workers != 0)
+			fprintf(stdout, "Files will be written by %u threads.\n",
+			        workers);
+
 		if (setNum != 0) fprintf(stdout, "Set %u will be read.\n", setNum);
 
+		if (setList != 0) fprintf(stdout, "Data sets will be listed.\n");
+
 		if (owner != (uid_t) -1)
 		{
 			pbuf = getpwuid(owner);
@@ -214,15 +297,32 @@ int main(int argc, char *argv[])
 				        gbuf->gr_name);
 		}
 
-		fprintf(stdout, "Files will be written to %s.\n", outPath);
+		if (catalogPath[0] != '\0')
+			fprintf(stdout, "A catalog will be written to %s.\n", catalogPath);
+
+		if (seekPath[0] != '\0')
+			fprintf(stdout, "Files will be found with catalog %s.\n",
+			        seekPath);
+
+		if (archivePath[0] != '\0')
+			fprintf(stdout, "Files will be archived to %s.\n", archivePath);
+		else
+			fprintf(stdout, "Files will be written to %s.\n", outPath);
 		fprintf(stdout, "Tape device will be %s.\n", device);
 
 		if (minFree != 0)
+		{
 			fprintf(stdout, "Free space of %lu bytes will be maintained.\n",
 			        minFree);
+			fprintf(stdout, "Writing will resume at %lu bytes free.\n",
+			        resumeFree);
+		}
 		
 		if (matchCnt > 0)
 			fprintf(stdout, "%u patterns were found.\n", matchCnt);
+
+		if (listCnt > 0)
+			fprintf(stdout, "%lu paths were listed.\n", listCnt);
 	}
 
 	if (stat(outPath, &sbuf) != 0)
@@ -246,13 +346,70 @@ int main(int argc, char *argv[])
 		return(-1);
 	}
 
+	if (mapTape() != 0)
+	{
+		fprintf(stderr, "Error mapping %s!\n", device);
+		goto error;
+	}
+
+	/* a tape image is listed by several threads scanning it in parts */
+	if ((list != 0) && (tapeMapped != 0) && (workers > 1) &&
+	    (setList == 0) && (seekPath[0] == '\0'))
+	{
+		if (scanImage() != 0)
+		{
+			fprintf(stderr, "Error scanning tape image!\n");
+			goto error;
+		}
+
+		goto finish;
+	}
+
+	/* a tape image without filemarks to space over has its sets scanned for */
+	if ((setList != 0) && (tapeMapped != 0))
+	{
+		result = scanSets();
+		if (result < 0)
+		{
+			fprintf(stderr, "Error listing data sets!\n");
+			goto error;
+		}
+		else if (result == 0)
+		{
+			goto finish;
+		}
+	}
+
 	if (openMedia() != 0)
 	{
 		fprintf(stderr, "Error opening tape!\n");
 		goto error;
 	}
 
-	if (setNum > 1)
+	if (setList != 0)
+	{
+		if (listSets() != 0)
+		{
+			fprintf(stderr, "Error listing data sets!\n");
+			goto error;
+		}
+
+		goto finish;
+	}
+
+	result = 1;
+
+	if ((setNum > 1) && (seekPath[0] == '\0'))
+	{
+		result = seekSet(setNum);
+		if (result < 0)
+		{
+			fprintf(stderr, "Error seeking to data set #%u!\n", setNum);
+			goto error;
+		}
+	}
+
+	if ((setNum > 1) && (seekPath[0] == '\0') && (result > 0))
 	{
 		op.mt_op = MTFSF;
 		op.mt_count = (setNum - 1) * 2;
@@ -260,7 +417,7 @@ int main(int argc, char *argv[])
 		if (verbose > 0)
 			fprintf(stdout, "Forwarding tape to data set #%u...\n", setNum);
 
-		if (ioctl(mtfd, MTIOCTOP, &op) != 0)
+		if (positionTape(&op) != 0)
 		{
 			fprintf(stderr, "Error forwarding tape!\n");
 			goto error;
@@ -294,6 +451,36 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if ((asyncIO != 0) && (startAsync() != 0))
+	{
+		fprintf(stderr, "Error starting asynchronous I/O!\n");
+		goto error;
+	}
+
+	if (startWorkers() != 0)
+	{
+		fprintf(stderr, "Error starting worker threads!\n");
+		goto error;
+	}
+
+	if (seekPath[0] != '\0')
+	{
+		if (restoreCatalog() != 0)
+		{
+			fprintf(stderr, "Error reading files found with catalog!\n");
+			goto error;
+		}
+
+		goto finish;
+	}
+
+	/* the media based catalog of each data set is spaced to when listing */
+	if (((list == 0) || (mbcType == MTF_NO_MBC)) && (startReader() != 0))
+	{
+		fprintf(stderr, "Error starting tape reader!\n");
+		goto error;
+	}
+
 next:
 
 	if (readDataSet() != 0)
@@ -309,23 +496,67 @@ next:
 		goto error;
 	}
 
+	if (drainWorkers() != 0)
+	{
+		fprintf(stderr, "Error writing files!\n");
+		goto error;
+	}
+
 	if ((result == 0) && (setNum == 0))
 		goto next;
 
+finish:
+
+	stopReader();
+	stopDecoders();
+
+	if (stopWorkers() != 0)
+	{
+		fprintf(stderr, "Error writing files!\n");
+		goto error;
+	}
+
+	if (stopAsync() != 0)
+	{
+		fprintf(stderr, "Error writing files!\n");
+		goto error;
+	}
+
+	if (closeArchive() != 0)
+	{
+		fprintf(stderr, "Error writing archive!\n");
+		goto error;
+	}
+
+	if (closeCatalog() != 0)
+	{
+		fprintf(stderr, "Error writing catalog!\n");
+		goto error;
+	}
+
+	freeCatalog();
+	reportMissing();
+
 	if (verbose > 0) fprintf(stdout, "Successful read of archive!\n");
 	
+	unmapTape();
 	close(mtfd);
 
 	return(0);
 
 error:
 
-	for (i = 0; i < matchCnt; i += 1)
-	{
-		regfree(&match[i]);
-	}
+	freePatterns();
 
+	stopReader();
+	stopDecoders();
+	stopWorkers();
+	stopAsync();
+	closeArchive();
+	closeCatalog();
+	freeCatalog();
 	dump("errorblock.dmp");
+	unmapTape();
 	if (mtfd != -1) close(mtfd);
 
 	return(-1);
@@ -471,6 +702,26 @@ INT16 parseArgs(int argc, char *argv[])
 				{
 					list = 1;
 				}
+				else if (*ptr == 'A')
+				{
+					asyncIO = 1;
+				}
+				else if (*ptr == 'P')
+				{
+					preallocate = 0;
+				}
+				else if (*ptr == 'C')
+				{
+					verify = 1;
+				}
+				else if (*ptr == 'G')
+				{
+					globs = 1;
+				}
+				else if (*ptr == 'S')
+				{
+					setList = 1;
+				}
 				else
 				{
 					fprintf(stderr, "Unrecognized switch (-%c)!\n", *ptr);
@@ -499,6 +750,26 @@ INT16 parseArgs(int argc, char *argv[])
 			{
 				list = 1;
 			}
+			else if (*ptr == 'A')
+			{
+				asyncIO = 1;
+			}
+			else if (*ptr == 'P')
+			{
+				preallocate = 0;
+			}
+			else if (*ptr == 'C')
+			{
+				verify = 1;
+			}
+			else if (*ptr == 'G')
+			{
+				globs = 1;
+			}
+			else if (*ptr == 'S')
+			{
+				setList = 1;
+			}
 			else if (strcmp(ptr, "s") == 0)
 			{
 				i += 1;
@@ -527,6 +798,62 @@ INT16 parseArgs(int argc, char *argv[])
 				if (whichDevice(argv[i]) != 0)
 					return(-1);
 			}
+			else if (strcmp(ptr, "a") == 0)
+			{
+				i += 1;
+
+				if (i == argc)
+				{
+					fprintf(stderr, "Argument required for -a switch!\n");
+					usage();
+					return(-1);
+				}
+
+				if (setArchive(argv[i]) != 0)
+					return(-1);
+			}
+			else if (strcmp(ptr, "X") == 0)
+			{
+				i += 1;
+
+				if (i == argc)
+				{
+					fprintf(stderr, "Argument required for -X switch!\n");
+					usage();
+					return(-1);
+				}
+
+				if (setCatalog(argv[i]) != 0)
+					return(-1);
+			}
+			else if (strcmp(ptr, "x") == 0)
+			{
+				i += 1;
+
+				if (i == argc)
+				{
+					fprintf(stderr, "Argument required for -x switch!\n");
+					usage();
+					return(-1);
+				}
+
+				if (setSeekCatalog(argv[i]) != 0)
+					return(-1);
+			}
+			else if (strcmp(ptr, "T") == 0)
+			{
+				i += 1;
+
+				if (i == argc)
+				{
+					fprintf(stderr, "Argument required for -T switch!\n");
+					usage();
+					return(-1);
+				}
+
+				if (loadPaths(argv[i]) != 0)
+					return(-1);
+			}
 			else if (strcmp(ptr, "b") == 0)
 			{
 				i += 1;
@@ -541,6 +868,48 @@ INT16 parseArgs(int argc, char *argv[])
 				if (setBlockSize(argv[i]) != 0)
 					return(-1);
 			}
+			else if (strcmp(ptr, "B") == 0)
+			{
+				i += 1;
+
+				if (i == argc)
+				{
+					fprintf(stderr, "Argument required for -B switch!\n");
+					usage();
+					return(-1);
+				}
+
+				if (setReadAhead(argv[i]) != 0)
+					return(-1);
+			}
+			else if (strcmp(ptr, "R") == 0)
+			{
+				i += 1;
+
+				if (i == argc)
+				{
+					fprintf(stderr, "Argument required for -R switch!\n");
+					usage();
+					return(-1);
+				}
+
+				if (setReadSize(argv[i]) != 0)
+					return(-1);
+			}
+			else if (strcmp(ptr, "j") == 0)
+			{
+				i += 1;
+
+				if (i == argc)
+				{
+					fprintf(stderr, "Argument required for -j switch!\n");
+					usage();
+					return(-1);
+				}
+
+				if (setWorkers(argv[i]) != 0)
+					return(-1);
+			}
 			else if (strcmp(ptr, "o") == 0)
 			{
 				i += 1;
@@ -611,6 +980,20 @@ INT16 parseArgs(int argc, char *argv[])
 				if (setMinFree(argv[i]) != 0)
 					return(-1);
 			}
+			else if (strcmp(ptr, "I") == 0)
+			{
+				i += 1;
+
+				if (i == argc)
+				{
+					fprintf(stderr, "Argument required for -I switch!\n");
+					usage();
+					return(-1);
+				}
+
+				if (setCheckInterval(argv[i]) != 0)
+					return(-1);
+			}
 			else
 			{
 				fprintf(stderr, "Unrecognized switch (-%c)!\n", *ptr);
@@ -682,6 +1065,51 @@ INT16 whichDevice(char *argv)
 }
 
 
+INT16 setArchive(char *argv)
+{
+	if (strlen(argv) > MAXPATHLEN)
+	{
+		fprintf(stderr, "Archive path (-a) is too long!\n");
+		usage();
+		return(-1);
+	}
+
+	strcpy(archivePath, argv);
+
+	return(0);
+}
+
+
+INT16 setCatalog(char *argv)
+{
+	if (strlen(argv) > MAXPATHLEN)
+	{
+		fprintf(stderr, "Catalog path (-X) is too long!\n");
+		usage();
+		return(-1);
+	}
+
+	strcpy(catalogPath, argv);
+
+	return(0);
+}
+
+
+INT16 setSeekCatalog(char *argv)
+{
+	if (strlen(argv) > MAXPATHLEN)
+	{
+		fprintf(stderr, "Catalog path (-x) is too long!\n");
+		usage();
+		return(-1);
+	}
+
+	strcpy(seekPath, argv);
+
+	return(0);
+}
+
+
 INT16 setBlockSize(char *argv)
 {
 	UINT32 test;
@@ -716,6 +1144,129 @@ INT16 setBlockSize(char *argv)
 }
 
 
+INT16 setReadAhead(char *argv)
+{
+	UINT32 test;
+
+	if (strspn(argv, "0123456789") != strlen(argv))
+	{
+		fprintf(stderr, "Invalid value given for read-ahead (-B)!\n");
+		usage();
+		return(-1);
+	}
+
+	if (sscanf(argv, "%lu", &test) != 1)
+	{
+		fprintf(stderr, "Unable to parse value given for read-ahead (-B)!\n");
+		usage();
+		return(-1);
+	}
+
+	if (test > (UINT32) MAX_READ_AHEAD)
+	{
+		fprintf(stderr,
+				"Value given for read-ahead (-B) is out of range (0-%u)!\n",
+				MAX_READ_AHEAD);
+		usage();
+		return(-1);
+	}
+
+	readAhead = (UINT16) test;
+
+	return(0);
+}
+
+
+INT16 setWorkers(char *argv)
+{
+	UINT32 test;
+
+	if (strspn(argv, "0123456789") != strlen(argv))
+	{
+		fprintf(stderr, "Invalid value given for threads (-j)!\n");
+		usage();
+		return(-1);
+	}
+
+	if (sscanf(argv, "%lu", &test) != 1)
+	{
+		fprintf(stderr, "Unable to parse value given for threads (-j)!\n");
+		usage();
+		return(-1);
+	}
+
+	if (test > (UINT32) MAX_WORKERS)
+	{
+		fprintf(stderr,
+				"Value given for threads (-j) is out of range (0-%u)!\n",
+				MAX_WORKERS);
+		usage();
+		return(-1);
+	}
+
+	workers = (UINT16) test;
+
+	return(0);
+}
+
+
+INT16 setReadSize(char *argv)
+{
+	char *ptr;
+	UINT32 multiplier;
+
+	if (strlen(argv) == 0)
+	{
+		fprintf(stderr, "No value given for read size (-R)!\n");
+		usage();
+		return(-1);
+	}
+
+	strlwr(argv);
+
+	ptr = argv;
+	while ((*ptr >= '0') && (*ptr <= '9'))
+		ptr += 1;
+
+	if (strlen(ptr) == 0)
+		multiplier = 1;
+	else if (strcmp(ptr, "k") == 0)
+		multiplier = 1024;
+	else if (strcmp(ptr, "m") == 0)
+		multiplier = 1048576;
+	else
+	{
+		fprintf(stderr, "Invalid multiplier given for read size (-R)!\n");
+		usage();
+		return(-1);
+	}
+
+	if (sscanf(argv, "%lu", &readSize) != 1)
+	{
+		fprintf(stderr, "Unable to parse value given for read size (-R)!\n");
+		usage();
+		return(-1);
+	}
+
+	if (readSize <= (UINT32) MAX_READ_SIZE / multiplier)
+		readSize *= multiplier;
+	else
+		readSize = 0;
+
+	if ((readSize < (UINT32) MIN_TAPE_BLOCK_SIZE) ||
+	    (readSize > (UINT32) MAX_READ_SIZE))
+	{
+		fprintf(stderr,
+				"Value given for read size (-R) is out of range (%u-%u)!\n",
+				MIN_TAPE_BLOCK_SIZE, MAX_READ_SIZE);
+		usage();
+		return(-1);
+	}
+
+	return(0);
+}
+
+
 INT16 setPath(char *argv)
 {
 	strcpy(outPath, argv);
@@ -819,49 +1370,104 @@ INT16 setCase(char *argv)
 INT16 setMinFree(char *argv)
 {
 	char *ptr;
-	UINT32 multiplier;
 
 	if (strlen(argv) == 0)
 	{
-		fprintf(stderr, "No value given for minimum free space (-f)!\n");
+		fprintf(stderr, "No value given for minimum free space (-F)!\n");
 		usage();
 		return(-1);
 	}
 
-	strlwr(argv);
-
-	ptr = argv;
-	while ((*ptr >= '0') && (*ptr <= '9'))
+	ptr = strchr(argv, ',');
+	if (ptr != NULL)
+	{
+		*ptr = '\0';
 		ptr += 1;
+	}
 
-	if (strlen(ptr) == 0)
-		multiplier = 0;
-	if (strcmp(ptr, "k") == 0)
-		multiplier = 1024;
-	else if (strcmp(ptr, "m") == 0)
-		multiplier = 1048576;
-	else
+	if (getBytes(argv, &minFree) != 0)
 	{
 		fprintf(stderr,
-		        "Invalid multiplier given for minimum free space (-f)!\n");
+		        "Unable to parse value given for minimum free space (-F)!\n");
 		usage();
 		return(-1);
 	}
 
-	if (sscanf(argv, "%lu", &minFree) != 1)
+	if (ptr == NULL)
+	{
+		resumeFree = minFree;
+	}
+	else if (getBytes(ptr, &resumeFree) != 0)
 	{
 		fprintf(stderr,
-		        "Unable to parse value given for minimum free space (-f)!\n");
+		        "Unable to parse value given for resuming free space (-F)!\n");
 		usage();
 		return(-1);
 	}
 
-	minFree *= multiplier;
+	if (resumeFree < minFree)
+	{
+		fprintf(stderr,
+		        "Free space to resume at (-F) is less than the minimum!\n");
+		usage();
+		return(-1);
+	}
 
 	return(0);
 } 
 
 
+INT16 setCheckInterval(char *argv)
+{
+	if ((getBytes(argv, &checkInterval) != 0) || (checkInterval == 0))
+	{
+		fprintf(stderr,
+		        "Unable to parse value given for free space interval (-I)!\n");
+		usage();
+		return(-1);
+	}
+
+	return(0);
+}
+
+
+/* getBytes() parses a count of bytes with an optional K or M suffix.         */
+
+INT16 getBytes(char *argv, UINT32 *bytes)
+{
+	char *ptr;
+	UINT32 multiplier;
+
+	strlwr(argv);
+
+	ptr = argv;
+	while ((*ptr >= '0') && (*ptr <= '9'))
+		ptr += 1;
+
+	if (ptr == argv)
+		return(-1);
+
+	if (strlen(ptr) == 0)
+		multiplier = 1;
+	else if (strcmp(ptr, "k") == 0)
+		multiplier = 1024;
+	else if (strcmp(ptr, "m") == 0)
+		multiplier = 1048576;
+	else
+		return(-1);
+
+	if (sscanf(argv, "%lu", bytes) != 1)
+		return(-1);
+
+	if (*bytes > ULONG_MAX / multiplier)
+		return(-1);
+
+	*bytes *= multiplier;
+
+	return(0);
+}
+
+
 INT16 getPatterns(int argc, char *argv[], int start)
 {
 	int i;
@@ -876,30 +1482,12 @@ INT16 getPatterns(int argc, char *argv[], int start)
 			return(-1);
 		}
 
-		if (strlen(argv[i]) >= MAX_PATTERN_LEN)
-		{
-			fprintf(stderr, "Pattern exceeds maximum length!\n");
-			usage();
-			return(-1);
-		}
-
-		if (matchCnt == MAX_PATTERN)
+		if (addPattern(argv[i], globs) != 0)
 		{
-			fprintf(stderr, "Maximum number of patterns exceeded!\n");
 			usage();
 			return(-1);
 		}
 
-		if (regcomp(&match[matchCnt], argv[i],
-		            REG_ICASE | REG_NOSUB | REG_NEWLINE) != 0)
-		{
-			fprintf(stderr, "Invalid pattern - \"%s\"!\n", argv[i]);
-			usage();
-			return(-1);
-		}
-
-		matchCnt += 1;
-
 		i += 1;
 	}
 
@@ -914,15 +1502,38 @@ void usage(void)
 	fprintf(stderr, "    -V               very verbose\n");
 	fprintf(stderr, "    -D               debug\n");
 	fprintf(stderr, "    -l               list contents\n");
+	fprintf(stderr, "    -A               use io_uring for tape reads and file writes\n");
+	fprintf(stderr, "    -P               do not preallocate files before writing them\n");
+	fprintf(stderr, "    -C               verify block, stream and data checksums\n");
 	fprintf(stderr, "    -b bytes         tape block size\n");
+	fprintf(stderr, "    -B blocks        number of tape blocks to read ahead;\n");
+	fprintf(stderr, "                     0 reads the tape synchronously\n");
+	fprintf(stderr, "    -R bytes[K|M]    bytes to read at a time from images and fixed\n");
+	fprintf(stderr, "                     block drives; tuned automatically by default\n");
+	fprintf(stderr, "    -j threads       number of threads writing files; 0 writes them\n");
+	fprintf(stderr, "                     as they are read; when listing a tape image,\n");
+	fprintf(stderr, "                     the number of threads scanning it\n");
 	fprintf(stderr, "    -d device        device to read from\n");
 	fprintf(stderr, "    -s set           number of data set to read\n");
+	fprintf(stderr, "    -S               list the data sets on the tape without reading\n");
+	fprintf(stderr, "                     their contents\n");
 	fprintf(stderr, "    -u user          assign owner to all files/directories written\n");
 	fprintf(stderr, "    -g group         assign group to all files/directories written\n");
 	fprintf(stderr, "    -c [lower|upper] force the case of paths\n");
 	fprintf(stderr, "    -o path          root path to write files to\n");
-	fprintf(stderr, "    -F bytes[K|M]    maintain minimum free space of bytes;\n");
-	fprintf(stderr, "                     a K or M suffix signifies kilobytes or megabytes\n");
+	fprintf(stderr, "    -a archive       write files to a pax archive instead; - writes\n");
+	fprintf(stderr, "                     it to standard output\n");
+	fprintf(stderr, "    -X catalog       write a catalog of the files read to catalog\n");
+	fprintf(stderr, "    -x catalog       seek straight to the selected files with a\n");
+	fprintf(stderr, "                     catalog written by -X from the same tape\n");
+	fprintf(stderr, "    -F bytes[K|M][,bytes[K|M]]\n");
+	fprintf(stderr, "                     maintain minimum free space of bytes, pausing\n");
+	fprintf(stderr, "                     until the second amount is free; a K or M\n");
+	fprintf(stderr, "                     suffix signifies kilobytes or megabytes\n");
+	fprintf(stderr, "    -I bytes[K|M]    bytes written between checks of free space\n");
+	fprintf(stderr, "    -G               patterns are shell globs rather than regexes\n");
+	fprintf(stderr, "    -T file          only read the file paths listed in file, one per\n");
+	fprintf(stderr, "                     line; paths never found are reported\n");
 	fprintf(stderr, "    pattern(s)       only read file paths that match regex pattern(s)\n");
 
 	return;
@@ -42,9 +42,37 @@ See mtf.c for version history, contibutors, etc.
 
 #define MIN_TAPE_BLOCK_SIZE 512
 #define MAX_TAPE_BLOCK_SIZE 65536
+#define TAPE_BUFFER_SIZE (2 * MAX_TAPE_BLOCK_SIZE)
 #define MAX_PRINT_STRING 100
-#define MAX_PATTERN_LEN 100
-#define MAX_PATTERN 20
+#define DEFAULT_READ_AHEAD 32
+#define MAX_READ_AHEAD 1024
+#define AUTO_READ_SIZE 8388608
+#define MAX_READ_SIZE 67108864
+#define MAX_TUNE_READS 8
+#define TUNE_GAIN 1.1
+#define SOFT_MARK_SCAN 64
+#define SCAN_PART_SIZE 4194304
+#define ASYNC_ENTRIES 256
+#define ASYNC_BUFFERS 64
+#define ASYNC_BUFFER_SIZE 262144
+#define MAX_WORKERS 64
+#define POOL_QUEUE 1024
+#define POOL_QUEUE_BYTES 67108864
+#define POOL_FILE_LIMIT 1048576
+#define DEFERRED_FILE -2
+#define DIR_CACHE_SLOTS 1024
+#define DIR_FDS 16
+#define STAGE_SIZE 1048576
+#define JOB_BUFFER_SIZE 65536
+#define FREE_CHECK_INTERVAL 67108864
+#define FREE_POLL_USEC 250000
+#define ARCHIVE_FILE -3
+#define ARCHIVE_BUFFER_SIZE 1048576
+#define TAR_BLOCK_SIZE 512
+#define TAR_RECORD_SIZE 10240
+#define MAX_DECODERS 16
+#define DECODE_FRAMES 32
+#define MAX_FRAME_SIZE 16777216
 
 #define CASE_SENSITIVE 0
 #define CASE_LOWER 1
@@ -428,6 +456,85 @@ typedef struct
 
 #define MTF_CMP_HDR_ID 0x4846
 
+/* bitmasks for MTF_CMP_HDR.attr */
+#define MTF_FRAME_COMPRESSED 0x0001
+
+/* The MTF specification does not assign MTF_SSET_BLK.softCompress values,   */
+/* so no algorithm is known by default and compressed streams are rejected.  */
+/* Define MTF_SOFT_LZS as the value used by the writing application to       */
+/* decode its streams as Stac LZS.                                           */
+
+/* media based catalog set map header, at the start of a TSMP or MAP2 stream */
+typedef struct
+{
+	UINT32	famId;		/* media family ID */
+	UINT16	count;		/* number of set map entries */
+	UINT8	pad[2];		/* pad */
+} MTF_SM_HDR;
+
+/* media based catalog set map entry, one per data set */
+typedef struct
+{
+	UINT16				length;			/* length of entry */
+	UINT16				seq;			/* media sequence number of SSET */
+	UINT32				attr;			/* SSET attributes */
+	UINT16				passEncrypt;	/* password encryption */
+	UINT16				softCompress;	/* software compression */
+	UINT16				vendor;			/* software vendor ID */
+	UINT16				num;			/* data set number */
+	UINT64				pba;			/* SSET physical block address */
+	UINT64				fddPba;			/* FDD physical block address */
+	UINT16				fddSeq;			/* media sequence number of FDD */
+	UINT32				dirs;			/* number of directories */
+	UINT32				files;			/* number of files */
+	UINT32				corrupt;		/* number of corrupt files */
+	UINT64				size;			/* data set displayable size */
+	UINT16				volumes;		/* number of volumes */
+	UINT8				pad[2];			/* pad */
+	MTF_TAPE_ADDRESS	name;			/* data set name */
+	MTF_TAPE_ADDRESS	desc;			/* data set description */
+	MTF_TAPE_ADDRESS	passwd;			/* data set password */
+	MTF_TAPE_ADDRESS	user;			/* user name */
+	MTF_DATE_TIME		date;			/* media write date */
+	INT8				tz;				/* time zone */
+	UINT8				ver;			/* MTF minor version */
+	UINT8				major;			/* software major version */
+	UINT8				minor;			/* software minor version */
+} MTF_SM_ENTRY;
+
+/* media based catalog file/directory detail (FDD) entry header, in TFDD or */
+/* FDD2 streams; addresses in entries are from the start of the entry        */
+typedef struct
+{
+	UINT16	length;		/* length of entry */
+	UINT32	type;		/* MTF_VOLB, MTF_DIRB, MTF_FILE or MTF_FEND */
+	UINT16	seq;		/* media sequence number */
+	UINT32	attr;		/* common block attributes */
+	UINT64	fla;		/* format logical address */
+	UINT64	size;		/* displayable size */
+	UINT32	link;		/* link to parent directory entry */
+	UINT8	osId;		/* OS ID */
+	UINT8	osVer;		/* OS version */
+	UINT8	strType;	/* string type */
+	UINT8	pad;		/* pad */
+} MTF_FDD_HDR;
+
+/* value for MTF_FDD_HDR.type marking the end of the FDD */
+#define MTF_FEND 0x444E4546
+
+/* FDD entry for MTF_FDD_HDR.type = MTF_DIRB or MTF_FILE */
+typedef struct
+{
+	MTF_FDD_HDR			common;		/* common entry header */
+	MTF_DATE_TIME		mod;		/* last modification date */
+	MTF_DATE_TIME		create;		/* creation date */
+	MTF_DATE_TIME		backup;		/* backup date */
+	MTF_DATE_TIME		access;		/* last access date */
+	UINT32				attr;		/* DIRB or FILE attributes */
+	MTF_TAPE_ADDRESS	name;		/* directory or file name */
+	MTF_TAPE_ADDRESS	osData;		/* OS-specific data */
+} MTF_FDD_ENTRY;
+
 
 /* prototypes for mtfread.c */
 INT32 openMedia(void);
@@ -437,6 +544,7 @@ INT32 readTapeBlock(void);
 INT32 readStartOfSetBlock(void);
 INT32 readVolumeBlock(void);
 INT32 readDirectoryBlock(void);
+INT32 makePath(char*);
 INT32 readFileBlock(void);
 INT32 readFile(UINT16);
 INT32 readCorruptObjectBlock(void);
@@ -444,15 +552,119 @@ INT32 readEndOfSetPadBlock(void);
 INT32 readEndOfSetBlock(void);
 INT32 readEndOfTapeMarkerBlock(void);
 INT32 readSoftFileMarkBlock(void);
-INT32 readNextBlock(UINT16);
+INT32 readNextBlock(UINT32);
 INT32 skipToNextBlock(void);
+INT32 skipFileBlock(void);
 INT32 skipOverStream(void);
 INT32 writeData(int);
-char *getString(UINT8, UINT16, UINT8*);
+INT32 reserveData(int, UINT64*);
+INT32 putData(int, UINT8*, UINT32);
+INT32 flushData(void);
+INT32 writeAll(int, UINT8*, size_t);
+INT32 seekData(int, off_t);
+INT32 waitForSpace(int);
+void spendSpace(UINT32);
+INT32 checkBlock(void);
+INT32 checkStream(MTF_STREAM_HDR*);
+void sumData(UINT8*, UINT32);
+void takeSum(UINT8*, UINT32*, UINT8*, UINT32);
+INT32 matchSum(UINT8*, UINT32);
+UINT8 *readStream(UINT32*, INT32*);
+char *getString(UINT8, UINT16, UINT8*, char*, size_t);
+
+/* prototypes for mtfio.c */
+struct mtop;
+INT32 mapTape(void);
+void unmapTape(void);
+UINT8 *tapeImage(size_t*);
+INT32 calibrateReads(void);
+INT32 positionTape(struct mtop*);
+INT32 seekTape(UINT64*);
+INT32 seekOffset(unsigned long long);
+unsigned long long tapeOffset(void);
+size_t tapeUnit(void);
+INT32 isSoftMark(UINT8*, size_t);
+void noteSoftMarks(UINT8*, size_t);
+INT32 copyTape(int, UINT8*, UINT64*);
+INT32 startReader(void);
+void stopReader(void);
+ssize_t readTape(UINT8**, size_t);
+
+/* prototypes for mtfuring.c */
+struct utimbuf;
+INT32 startAsync(void);
+INT32 stopAsync(void);
+INT32 startAsyncReads(size_t, UINT16);
+ssize_t readAsync(UINT8*, size_t);
+void stopAsyncReads(void);
+INT32 asyncWrite(int, UINT8*, size_t);
+INT32 asyncSeek(int, off_t);
+INT32 asyncClose(int, char*, struct utimbuf*);
+
+/* prototypes for mtfpool.c */
+INT32 startWorkers(void);
+INT32 stopWorkers(void);
+INT32 drainWorkers(void);
+INT32 beginJob(int, char*, char*);
+INT32 jobWrite(UINT8*, size_t);
+INT32 jobFile(void);
+INT32 finishJob(struct utimbuf*);
+
+/* prototypes for mtftar.c */
+INT32 openArchive(char*);
+INT32 closeArchive(void);
+INT32 archiveDirectory(char*, struct utimbuf*);
+INT32 beginArchiveFile(char*, struct utimbuf*);
+INT32 archiveSize(UINT64*);
+INT32 archiveWrite(UINT8*, size_t);
+void skipArchiveFile(char*);
+INT32 finishArchiveFile(void);
+
+/* prototypes for mtfcmp.c */
+INT32 readCompressed(int, UINT32, UINT64*, off_t*);
+void stopDecoders(void);
+
+/* prototypes for mtfcat.c */
+INT32 openCatalog(char*);
+INT32 closeCatalog(void);
+void catalogTape(void);
+INT32 catalogSet(char*, unsigned long long);
+INT32 catalogEntry(UINT32, char*);
+INT32 loadCatalog(char*);
+INT32 restoreCatalog(void);
+void freeCatalog(void);
+INT32 listMediaCatalog(void);
+
+/* prototypes for mtfset.c */
+INT32 listSets(void);
+INT32 seekSet(UINT16);
+void printSet(UINT16, char*, UINT32, UINT8*, unsigned long long);
+
+/* prototypes for mtfscan.c */
+INT32 scanImage(void);
+INT32 scanSets(void);
+
+/* prototypes for mtfmatch.c */
+INT32 addPattern(char*, UINT8);
+INT32 compilePatterns(void);
+INT32 matchPath(char*);
+INT32 matchDir(char*);
+INT32 loadPaths(char*);
+UINT32 reportMissing(void);
+void freePatterns(void);
 
 /* prototypes for mtfutil.c */
 void strlwr(char*);
 void strupr(char*);
 void increment64(UINT64*, UINT32);
 void decrement64(UINT64*, UINT32);
+UINT16 headerSum(void*, size_t);
+UINT32 xorWords(UINT8*, size_t);
 void dump(char*);
+INT32 knownDir(char*);
+INT32 addDir(char*);
+int openDir(char*);
+int holdDir(int);
+void closeDir(int);
+INT32 setTimes(int, char*, struct utimbuf*);
+time_t getTime(UINT8*);
@@ -0,0 +1,758 @@
+/*
+
+mtf - a Microsoft Tape Format reader (and future writer?)
+Copyright (C) 1999  D. Alan Stewart, Layton Graphics, Inc.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+Contact the author at:
+
+D. Alan Stewart
+Layton Graphics, Inc.
+155 Woolco Dr.
+Marietta, GA 30062, USA
+astewart@layton-graphics.com
+
+See mtf.c for version history, contributors, etc.
+
+**
+**	mtfcat.c
+**
+**	functions for writing a catalog of the data sets, directories and files
+**	read from a tape, and for using one to seek straight to the files to be
+**	restored instead of reading everything before them; also for listing
+**	data sets from the media based catalog written on the tape itself
+**
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <utime.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include "mtf.h"
+
+
+extern char outPath[MAXPATHLEN + 1], curPath[MAXPATHLEN + 1];
+extern UINT8 verbose, debug, list, forceCase, archiving, selecting;
+extern UINT16 setNum, flbSize, setCompress;
+extern UINT32 remaining;
+extern UINT8 *tData;
+extern int filemark, curDir;
+extern MTF_DB_HDR *dbHdr;
+extern MTF_TAPE_BLK *tape;
+extern MTF_SSET_BLK *sset;
+extern MTF_DIRB_BLK *dirb;
+extern MTF_FILE_BLK *file;
+extern MTF_ESET_BLK *eset;
+extern MTF_STREAM_HDR *stream;
+
+
+/* catalog file header */
+typedef struct
+{
+	UINT32	magic;		/* CATALOG_MAGIC */
+	UINT16	ver;		/* CATALOG_VERSION */
+	UINT32	famId;		/* media family ID of the tape */
+	UINT16	seq;		/* media sequence number of the tape */
+	UINT16	flbSize;	/* format logical block size */
+	UINT32	blockSize;	/* units of pba: tape block size, 1 for an image */
+	UINT32	count;		/* number of entries */
+} CATALOG_HDR;
+
+/* catalog entry, followed by length bytes of name */
+typedef struct
+{
+	UINT32	type;		/* MTF_SSET, MTF_DIRB or MTF_FILE */
+	UINT16	set;		/* data set number */
+	UINT16	compress;	/* software compression of the data set */
+	UINT64	pba;		/* unit holding the descriptor block */
+	UINT32	offset;		/* offset of the descriptor block in it */
+	UINT64	fla;		/* format logical address */
+	UINT64	size;		/* displayable size */
+	UINT16	off;		/* offset to first event */
+	UINT32	mod;		/* modification time */
+	UINT32	access;		/* access time */
+	UINT16	length;		/* length of name */
+} CATALOG_ENTRY;
+
+#define CATALOG_MAGIC 0x4354464D
+#define CATALOG_VERSION 2
+
+
+UINT8 cataloging = 0;
+
+static FILE *catalog = NULL;
+static CATALOG_HDR catHdr;
+static UINT8 *catText = NULL;
+static size_t catSize = 0;
+static UINT16 catSet = 0, catCompress = 0;
+static unsigned long long catStart = 0, catFla = 0;
+
+
+static unsigned long long bigValue(UINT64*);
+static void setBig(UINT64*, unsigned long long);
+static INT32 restoreFile(CATALOG_ENTRY*, char*);
+static INT32 listSetMap(UINT8*, UINT32, UINT8);
+static INT32 listFdd(UINT8*, UINT32);
+
+
+/* openCatalog() creates the catalog that the data sets, directories and      */
+/* files read are entered into. Its header is completed by closeCatalog().    */
+
+INT32 openCatalog(char *path)
+{
+	catalog = fopen(path, "wb");
+	if (catalog == NULL)
+	{
+		fprintf(stderr, "Error %d opening/creating %s for writing!\n", errno,
+		        path);
+		return(-1);
+	}
+
+	memset(&catHdr, 0, sizeof(catHdr));
+	catHdr.magic = CATALOG_MAGIC;
+	catHdr.ver = CATALOG_VERSION;
+
+	if (fwrite(&catHdr, sizeof(catHdr), 1, catalog) != 1)
+	{
+		fprintf(stderr, "Error %d writing catalog!\n", errno);
+		return(-1);
+	}
+
+	cataloging = 1;
+
+	return(0);
+}
+
+
+/* closeCatalog() writes the final header of the catalog and closes it.       */
+
+INT32 closeCatalog(void)
+{
+	INT32 result;
+
+	if (catalog == NULL)
+		return(0);
+
+	result = 0;
+
+	if ((fseek(catalog, 0, SEEK_SET) != 0) ||
+	    (fwrite(&catHdr, sizeof(catHdr), 1, catalog) != 1))
+	{
+		fprintf(stderr, "Error %d writing catalog!\n", errno);
+		result = -1;
+	}
+
+	if ((fclose(catalog) != 0) && (result == 0))
+	{
+		fprintf(stderr, "Error %d closing catalog!\n", errno);
+		result = -1;
+	}
+
+	if ((result == 0) && (verbose > 0))
+		fprintf(stdout, "%lu entries were cataloged.\n", catHdr.count);
+
+	catalog = NULL;
+	cataloging = 0;
+
+	return(result);
+}
+
+
+/* catalogTape() notes the tape that a catalog is written for or checked     */
+/* against, from the TAPE block, and the units positions on it are counted in */
+/* (see tapeUnit()).                                                          */
+
+void catalogTape(void)
+{
+	catHdr.famId = tape->famId;
+	catHdr.seq = tape->seq;
+	catHdr.flbSize = tape->flbSize;
+	catHdr.blockSize = (UINT32) tapeUnit();
+
+	return;
+}
+
+
+/* catalogSet() notes where the data set being read starts: at offset bytes   */
+/* into a tape image, or at the physical block address in its SSET block on a */
+/* drive. Any later descriptor block of the set is found from there and how   */
+/* many logical blocks it is past the SSET block.                             */
+
+INT32 catalogSet(char *name, unsigned long long offset)
+{
+	catSet = sset->num;
+	catCompress = sset->softCompress;
+	catFla = bigValue(&dbHdr->fla);
+
+	if (catHdr.blockSize == 1)
+		catStart = offset;
+	else
+		catStart = bigValue(&sset->pba);
+
+	return(catalogEntry(MTF_SSET, name));
+}
+
+
+/* catalogEntry() enters the descriptor block being read into the catalog     */
+/* under name, which is the data set name for an SSET block, the directory    */
+/* path for a DIRB block and the file name for a FILE block.                  */
+
+INT32 catalogEntry(UINT32 type, char *name)
+{
+	CATALOG_ENTRY entry;
+	unsigned long long bytes;
+
+	if (cataloging == 0)
+		return(0);
+
+	memset(&entry, 0, sizeof(entry));
+
+	bytes = (bigValue(&dbHdr->fla) - catFla) * flbSize;
+
+	entry.type = type;
+	entry.set = catSet;
+	entry.compress = catCompress;
+	setBig(&entry.pba, catStart + bytes / catHdr.blockSize);
+	entry.offset = (UINT32) (bytes % catHdr.blockSize);
+	entry.fla = dbHdr->fla;
+	entry.size = dbHdr->size;
+	entry.off = dbHdr->off;
+	entry.length = (UINT16) strlen(name);
+
+	if (type == MTF_DIRB)
+	{
+		entry.mod = (UINT32) getTime(dirb->mod);
+		entry.access = (UINT32) getTime(dirb->access);
+	}
+	else if (type == MTF_FILE)
+	{
+		entry.mod = (UINT32) getTime(file->mod);
+		entry.access = (UINT32) getTime(file->access);
+	}
+
+	if ((fwrite(&entry, sizeof(entry), 1, catalog) != 1) ||
+	    (fwrite(name, entry.length, 1, catalog) != (entry.length > 0 ? 1 : 0)))
+	{
+		fprintf(stderr, "Error %d writing catalog!\n", errno);
+		return(-1);
+	}
+
+	catHdr.count += 1;
+
+	return(0);
+}
+
+
+/* loadCatalog() reads a catalog written by an earlier run into memory.       */
+
+INT32 loadCatalog(char *path)
+{
+	struct stat sbuf;
+	int fd;
+	ssize_t got;
+
+	fd = open(path, O_RDONLY);
+	if ((fd == -1) || (fstat(fd, &sbuf) != 0))
+	{
+		fprintf(stderr, "Error %d opening catalog %s!\n", errno, path);
+		if (fd != -1) close(fd);
+		return(-1);
+	}
+
+	catSize = (size_t) sbuf.st_size;
+
+	catText = (UINT8*) malloc(max(catSize, 1));
+	if (catText == NULL)
+	{
+		fprintf(stderr, "Memory error while reading catalog!\n");
+		close(fd);
+		return(-1);
+	}
+
+	got = read(fd, catText, catSize);
+	close(fd);
+
+	if (got != (ssize_t) catSize)
+	{
+		fprintf(stderr, "Error %d reading catalog %s!\n", errno, path);
+		return(-1);
+	}
+
+	if ((catSize < sizeof(CATALOG_HDR)) ||
+	    (((CATALOG_HDR*) catText)->magic != CATALOG_MAGIC) ||
+	    (((CATALOG_HDR*) catText)->ver != CATALOG_VERSION))
+	{
+		fprintf(stderr, "%s is not a catalog!\n", path);
+		return(-1);
+	}
+
+	return(0);
+}
+
+
+/* restoreCatalog() reads the selected files using the catalog loaded by      */
+/* loadCatalog(). The tape is positioned at each file's descriptor block and  */
+/* only that file is read, unless it follows straight on from the last file  */
+/* read. Directories that no pattern can match are passed over without        */
+/* touching the tape, and in list mode the tape is not read at all.           */
+
+INT32 restoreCatalog(void)
+{
+	CATALOG_HDR *hdr;
+	CATALOG_ENTRY *entry;
+	UINT8 *ptr, *end;
+	UINT8 prune;
+	UINT32 count;
+	char name[MAXPATHLEN + 1], fullPath[MAXPATHLEN + 1];
+	struct utimbuf utbuf;
+
+	hdr = (CATALOG_HDR*) catText;
+
+	if ((hdr->famId != catHdr.famId) || (hdr->seq != catHdr.seq) ||
+	    (hdr->flbSize != catHdr.flbSize) ||
+	    (hdr->blockSize != catHdr.blockSize))
+	{
+		fprintf(stderr, "Catalog was not made from this tape!\n");
+		return(-1);
+	}
+
+	ptr = catText + sizeof(CATALOG_HDR);
+	end = catText + catSize;
+	prune = 1;
+	count = 0;
+
+	while (count < hdr->count)
+	{
+		entry = (CATALOG_ENTRY*) ptr;
+
+		if ((ptr + sizeof(CATALOG_ENTRY) > end) ||
+		    (ptr + sizeof(CATALOG_ENTRY) + entry->length > end))
+		{
+			fprintf(stderr, "Catalog is truncated!\n");
+			return(-1);
+		}
+
+		if (entry->length > MAXPATHLEN)
+		{
+			fprintf(stderr, "Catalog is corrupt!\n");
+			return(-1);
+		}
+
+		memcpy(name, ptr + sizeof(CATALOG_ENTRY), entry->length);
+		name[entry->length] = '\0';
+
+		ptr += sizeof(CATALOG_ENTRY) + entry->length;
+		count += 1;
+
+		if ((setNum != 0) && (entry->set != setNum))
+			continue;
+
+		if (entry->type == MTF_SSET)
+		{
+			if (verbose > 0) fprintf(stdout, "Data Set Name: %s\n", name);
+
+			setCompress = entry->compress;
+			prune = 1;
+		}
+		else if (entry->type == MTF_DIRB)
+		{
+			strcpy(curPath, name);
+
+			closeDir(curDir);
+			curDir = -1;
+
+			if (forceCase == CASE_LOWER)
+				strlwr(curPath);
+			else if (forceCase == CASE_UPPER)
+				strupr(curPath);
+
+			if (snprintf(fullPath, sizeof(fullPath), "%s/%s", outPath,
+			             curPath) >= (int) sizeof(fullPath))
+			{
+				fprintf(stderr, "Path of %s is too long!\n", curPath);
+				return(-1);
+			}
+
+			prune = ((selecting != 0) && (matchDir(curPath) == 0));
+
+			if ((prune != 0) && (verbose > 0))
+				fprintf(stdout, "%s cannot match any patterns... skipping!\n",
+				        curPath);
+
+			utbuf.actime = (time_t) entry->access;
+			utbuf.modtime = (time_t) entry->mod;
+
+			if ((list == 0) && (archiving != 0) && (selecting == 0))
+			{
+				if (archiveDirectory(curPath, &utbuf) != 0)
+					return(-1);
+			}
+			else if ((list == 0) && (archiving == 0) && (selecting == 0))
+			{
+				if (makePath(fullPath) != 0)
+					return(-1);
+			}
+		}
+		else if ((entry->type == MTF_FILE) && (prune == 0))
+		{
+			if (restoreFile(entry, name) != 0)
+				return(-1);
+		}
+	}
+
+	return(0);
+}
+
+
+/* freeCatalog() frees a catalog loaded by loadCatalog().                     */
+
+void freeCatalog(void)
+{
+	free(catText);
+	catText = NULL;
+	catSize = 0;
+
+	return;
+}
+
+
+/* restoreFile() reads one file entered in the catalog, if it is selected.    */
+/* The tape is positioned at its descriptor block unless that is where the    */
+/* last file read left it.                                                    */
+
+static INT32 restoreFile(CATALOG_ENTRY *entry, char *name)
+{
+	char filePath[MAXPATHLEN + 1];
+	MTF_DB_HDR *next;
+	INT32 result;
+
+	if (snprintf(filePath, sizeof(filePath), "%s%s", curPath, name) >=
+	    (int) sizeof(filePath))
+	{
+		fprintf(stderr, "Path of %s is too long!\n", name);
+		return(-1);
+	}
+
+	if (forceCase == CASE_LOWER)
+		strlwr(filePath);
+	else if (forceCase == CASE_UPPER)
+		strupr(filePath);
+
+	if ((selecting != 0) && (matchPath(filePath) == 0))
+		return(0);
+
+	if (list != 0)
+	{
+		fprintf(stdout, "%s/%s\n", outPath, filePath);
+		return(0);
+	}
+
+	next = (MTF_DB_HDR*) tData;
+
+	if ((filemark != 0) || (remaining < sizeof(MTF_DB_HDR)) ||
+	    (next->type != MTF_FILE) || (next->fla.least != entry->fla.least) ||
+	    (next->fla.most != entry->fla.most))
+	{
+		if (debug > 0)
+			printf("seeking to block %lu:%lu offset %lu for %s\n",
+			       entry->pba.most, entry->pba.least, entry->offset, filePath);
+
+		if (catHdr.blockSize == 1)
+			result = seekOffset(bigValue(&entry->pba));
+		else
+			result = seekTape(&entry->pba);
+
+		if (result != 0)
+		{
+			fprintf(stderr, "Error positioning tape for %s!\n", filePath);
+			return(-1);
+		}
+
+		filemark = 0;
+		remaining = 0;
+
+		/* a seek to the first block of a set may stop before its filemark */
+		result = readNextBlock(0);
+		if (result == 1)
+		{
+			filemark = 0;
+			result = readNextBlock(0);
+		}
+
+		if (result != 0)
+		{
+			fprintf(stderr, "Error reading tape block!\n");
+			return(-1);
+		}
+
+		if ((entry->offset != 0) && (readNextBlock(entry->offset) != 0))
+		{
+			fprintf(stderr, "Error reading tape block!\n");
+			return(-1);
+		}
+
+		next = (MTF_DB_HDR*) tData;
+	}
+
+	if ((next->type != MTF_FILE) || (next->fla.least != entry->fla.least) ||
+	    (next->fla.most != entry->fla.most))
+	{
+		fprintf(stderr, "Catalog does not match tape at %s!\n", filePath);
+		return(-1);
+	}
+
+	dbHdr = next;
+	file = (MTF_FILE_BLK*) dbHdr;
+
+	if (verbose > 0) fprintf(stdout, "\nReading FILE block...\n");
+
+	return(readFileBlock());
+}
+
+
+/* listMediaCatalog() lists the files of a data set from the media based     */
+/* catalog streams of its ESET block: the set map (TSMP or MAP2), describing  */
+/* every data set so far, and the file/directory detail (TFDD or FDD2),      */
+/* naming each directory and file of the set. It leaves the tape at the end  */
+/* of the ESET block.                                                         */
+
+INT32 listMediaCatalog(void)
+{
+	UINT8 *data, strType;
+	UINT32 length, id;
+	INT32 offset, result;
+
+	strType = eset->common.strType;
+
+	if (eset->common.off < flbSize)
+	{
+		stream = (MTF_STREAM_HDR*) ((char*) eset + eset->common.off);
+	}
+	else
+	{
+		if (readNextBlock(eset->common.off) != 0)
+		{
+			fprintf(stderr, "Error reading tape block!\n");
+			return(-1);
+		}
+
+		stream = (MTF_STREAM_HDR*) tData;
+	}
+
+	while ((filemark == 0) && (stream->id != MTF_SPAD))
+	{
+		id = stream->id;
+
+		if ((id == MTF_TSMP) || (id == MTF_MAP2) || (id == MTF_TFDD) ||
+		    (id == MTF_FDD2))
+		{
+			data = readStream(&length, &offset);
+			if (data == NULL)
+			{
+				fprintf(stderr, "Error reading catalog stream!\n");
+				return(-1);
+			}
+
+			if ((id == MTF_TSMP) || (id == MTF_MAP2))
+				result = listSetMap(data, length, strType);
+			else
+				result = listFdd(data, length);
+
+			free(data);
+
+			if (result != 0)
+				return(-1);
+		}
+		else
+		{
+			offset = skipOverStream();
+			if (offset < 0)
+			{
+				fprintf(stderr, "Error traversing stream!\n");
+				return(-1);
+			}
+		}
+
+		stream = (MTF_STREAM_HDR*) &tData[offset];
+	}
+
+	if ((filemark == 0) && (skipOverStream() < 0))
+	{
+		fprintf(stderr, "Error traversing stream!\n");
+		return(-1);
+	}
+
+	return(0);
+}
+
+
+/* listSetMap() prints the data sets described by a set map.                 */
+
+static INT32 listSetMap(UINT8 *data, UINT32 length, UINT8 strType)
+{
+	MTF_SM_HDR *hdr;
+	MTF_SM_ENTRY *entry;
+	UINT32 pos;
+	UINT16 i;
+	char *ptr, string[MAXPATHLEN + 1];
+
+	if (verbose == 0)
+		return(0);
+
+	if (length < sizeof(MTF_SM_HDR))
+	{
+		fprintf(stderr, "Set map is truncated!\n");
+		return(-1);
+	}
+
+	hdr = (MTF_SM_HDR*) data;
+	pos = sizeof(MTF_SM_HDR);
+
+	for (i = 0; i < hdr->count; i += 1)
+	{
+		entry = (MTF_SM_ENTRY*) &data[pos];
+
+		if ((pos + sizeof(MTF_SM_ENTRY) > length) ||
+		    (entry->length < sizeof(MTF_SM_ENTRY)) ||
+		    (pos + entry->length > length))
+		{
+			fprintf(stderr, "Set map is truncated!\n");
+			return(-1);
+		}
+
+		if ((UINT32) entry->name.offset + entry->name.size > entry->length)
+		{
+			fprintf(stderr, "Set map is corrupt!\n");
+			return(-1);
+		}
+
+		ptr = getString(strType, entry->name.size,
+		                (UINT8*) entry + entry->name.offset, string,
+		                sizeof(string));
+
+		fprintf(stdout, "Data Set %u: %s (%lu directories, %lu files)\n",
+		        entry->num, ptr, entry->dirs, entry->files);
+
+		pos += entry->length;
+	}
+
+	return(0);
+}
+
+
+/* listFdd() prints the paths of the files in a file/directory detail, as    */
+/* readFileBlock() would in list mode. Directories that no pattern can match */
+/* are passed over.                                                           */
+
+static INT32 listFdd(UINT8 *data, UINT32 length)
+{
+	MTF_FDD_ENTRY *entry;
+	UINT32 pos;
+	UINT8 prune;
+	char *ptr, filePath[MAXPATHLEN + 1], string[MAXPATHLEN + 1];
+
+	pos = 0;
+	prune = 0;
+
+	while (pos + sizeof(MTF_FDD_HDR) <= length)
+	{
+		entry = (MTF_FDD_ENTRY*) &data[pos];
+
+		if ((entry->common.length < sizeof(MTF_FDD_HDR)) ||
+		    (pos + entry->common.length > length))
+		{
+			fprintf(stderr, "FDD entry is corrupt!\n");
+			return(-1);
+		}
+
+		if (entry->common.type == MTF_FEND)
+			break;
+
+		if ((entry->common.type == MTF_DIRB) ||
+		    (entry->common.type == MTF_FILE))
+		{
+			if ((entry->common.length < sizeof(MTF_FDD_ENTRY)) ||
+			    ((UINT32) entry->name.offset + entry->name.size >
+			     entry->common.length))
+			{
+				fprintf(stderr, "FDD entry is corrupt!\n");
+				return(-1);
+			}
+
+			ptr = getString(entry->common.strType, entry->name.size,
+			                (UINT8*) entry + entry->name.offset, string,
+			                sizeof(string));
+		}
+
+		if (entry->common.type == MTF_DIRB)
+		{
+			strcpy(curPath, ptr);
+
+			if (forceCase == CASE_LOWER)
+				strlwr(curPath);
+			else if (forceCase == CASE_UPPER)
+				strupr(curPath);
+
+			prune = ((selecting != 0) && (matchDir(curPath) == 0));
+
+			if (verbose > 0) fprintf(stdout, "Directory Name: %s\n", curPath);
+		}
+		else if ((entry->common.type == MTF_FILE) && (prune == 0))
+		{
+			if (snprintf(filePath, sizeof(filePath), "%s%s", curPath, ptr) >=
+			    (int) sizeof(filePath))
+			{
+				fprintf(stderr, "Path of %s is too long!\n", ptr);
+				return(-1);
+			}
+
+			if (forceCase == CASE_LOWER)
+				strlwr(filePath);
+			else if (forceCase == CASE_UPPER)
+				strupr(filePath);
+
+			if ((selecting == 0) || (matchPath(filePath) != 0))
+				fprintf(stdout, "%s/%s\n", outPath, filePath);
+		}
+
+		pos += entry->common.length;
+	}
+
+	return(0);
+}
+
+
+static unsigned long long bigValue(UINT64 *big)
+{
+	return(((unsigned long long) big->most << 32) +
+	       (unsigned long long) big->least);
+}
+
+
+static void setBig(UINT64 *big, unsigned long long value)
+{
+	big->least = (UINT32) (value & 0xFFFFFFFFULL);
+	big->most = (UINT32) (value >> 32);
+
+	return;
+}
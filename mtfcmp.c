@@ -0,0 +1,604 @@
+/*
+
+mtf - a Microsoft Tape Format reader (and future writer?)
+Copyright (C) 1999  D. Alan Stewart, Layton Graphics, Inc.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+Contact the author at:
+
+D. Alan Stewart
+Layton Graphics, Inc.
+155 Woolco Dr.
+Marietta, GA 30062, USA
+astewart@layton-graphics.com
+
+See mtf.c for version history, contributors, etc.
+
+**
+**	mtfcmp.c
+**
+**	functions for decoding software compressed streams, with frames
+**	decompressed in parallel
+**
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "mtf.h"
+
+
+extern UINT8 verbose, debug, verify;
+extern UINT8 *tData;
+extern UINT32 remaining;
+extern UINT16 setCompress;
+
+
+#define FRAME_FREE 0
+#define FRAME_QUEUED 1
+#define FRAME_BUSY 2
+#define FRAME_DONE 3
+
+
+typedef INT32 (*DECODE_FUNC)(UINT8*, UINT32, UINT8*, UINT32);
+
+typedef struct
+{
+	UINT16		id;			/* MTF_SSET_BLK.softCompress */
+	char		*name;		/* for messages */
+	DECODE_FUNC	decode;		/* decompresses one frame */
+} DECODER;
+
+
+typedef struct
+{
+	UINT8		*in;		/* frame as read from tape */
+	UINT32		inSize;		/* bytes of it */
+	UINT32		inAlloc;	/* size of in */
+	UINT8		*out;		/* decompressed frame */
+	UINT32		outSize;	/* bytes of it */
+	UINT32		outAlloc;	/* size of out */
+	UINT8		packed;		/* frame is compressed rather than stored */
+	UINT8		state;		/* FRAME_FREE, FRAME_QUEUED, etc. */
+	INT32		result;		/* returned by decoder */
+} DECODE_FRAME;
+
+
+#ifdef MTF_SOFT_LZS
+static INT32 decodeLZS(UINT8*, UINT32, UINT8*, UINT32);
+#endif
+
+static DECODER decoderTable[] =
+{
+#ifdef MTF_SOFT_LZS
+	{ MTF_SOFT_LZS, "Stac LZS", decodeLZS },
+#endif
+	{ 0, NULL, NULL }
+};
+
+
+static DECODER *decoder = NULL;
+static pthread_t decoders[MAX_DECODERS];
+static UINT16 decoderCnt = 0;
+static pthread_mutex_t frameLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t frameQueued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t frameDone = PTHREAD_COND_INITIALIZER;
+static DECODE_FRAME frames[DECODE_FRAMES];
+static UINT16 frameHead = 0, frameTail = 0, framesPending = 0;
+static UINT8 decodeStop;
+
+
+static INT32 startDecoders(void);
+static void *decoderMain(void*);
+static INT32 takeStream(UINT8*, UINT32, UINT32*, UINT64*);
+static INT32 putFrame(int);
+static void discardFrames(void);
+static INT32 growBuffer(UINT8**, UINT32*, UINT32);
+
+
+/* readCompressed() reads a compressed stream of length bytes, starting at    */
+/* offset in the current tape block, and writes it decompressed to file. Each */
+/* frame is handed to the decoder threads as soon as it is read, and frames   */
+/* are written in order as they finish. The offset following the stream is    */
+/* returned, and the number of bytes written is returned through written.     */
+
+INT32 readCompressed(int file, UINT32 offset, UINT64 *length, off_t *written)
+{
+	MTF_CMP_HDR cmp;
+	DECODE_FRAME *frame;
+	UINT8 first;
+
+	if (startDecoders() != 0)
+		return(-1);
+
+	discardFrames();
+
+	*written = 0;
+	first = 1;
+
+	while ((length->most > 0) || (length->least > 0))
+	{
+		if (takeStream((UINT8*) &cmp, sizeof(MTF_CMP_HDR), &offset,
+		               length) != 0)
+			goto error;
+
+		if (debug > 0)
+			printf("frame %u: %lu bytes from %lu\n", cmp.seq, cmp.uncompress,
+			       cmp.compress);
+
+		if (cmp.id != MTF_CMP_HDR_ID)
+		{
+			fprintf(stderr, "Invalid compression frame header!\n");
+			goto error;
+		}
+
+		if ((verify != 0) &&
+		    (headerSum(&cmp, sizeof(MTF_CMP_HDR) - sizeof(UINT16)) != cmp.check))
+		{
+			fprintf(stderr,
+			        "Checksum of compression frame header does not match!\n");
+			goto error;
+		}
+
+		if ((cmp.compress > MAX_FRAME_SIZE) ||
+		    (cmp.uncompress > MAX_FRAME_SIZE) ||
+		    (((cmp.attr & MTF_FRAME_COMPRESSED) == 0) &&
+		     (cmp.compress != cmp.uncompress)))
+		{
+			fprintf(stderr, "Invalid compression frame size!\n");
+			goto error;
+		}
+
+		if ((first != 0) && (file == ARCHIVE_FILE) &&
+		    (archiveSize(&cmp.remain) != 0))
+			goto error;
+
+		first = 0;
+
+		frame = &frames[frameHead];
+
+		if ((frame->state != FRAME_FREE) && (putFrame(file) != 0))
+			goto error;
+
+		if ((growBuffer(&frame->in, &frame->inAlloc, cmp.compress) != 0) ||
+		    (growBuffer(&frame->out, &frame->outAlloc, cmp.uncompress) != 0))
+		{
+			fprintf(stderr, "Unable to allocate compression frame!\n");
+			goto error;
+		}
+
+		if (takeStream(frame->in, cmp.compress, &offset, length) != 0)
+			goto error;
+
+		frame->inSize = cmp.compress;
+		frame->outSize = cmp.uncompress;
+		frame->packed = ((cmp.attr & MTF_FRAME_COMPRESSED) != 0);
+		frame->result = 0;
+
+		*written += cmp.uncompress;
+
+		pthread_mutex_lock(&frameLock);
+
+		if (frame->packed != 0)
+		{
+			frame->state = FRAME_QUEUED;
+			pthread_cond_signal(&frameQueued);
+		}
+		else
+		{
+			frame->state = FRAME_DONE;
+		}
+
+		pthread_mutex_unlock(&frameLock);
+
+		frameHead = (frameHead + 1) % DECODE_FRAMES;
+		framesPending += 1;
+	}
+
+	while (framesPending > 0)
+	{
+		if (putFrame(file) != 0)
+			goto error;
+	}
+
+	return(offset);
+
+error:
+	discardFrames();
+
+	return(-1);
+}
+
+
+/* stopDecoders() stops the decoder threads and frees the frame buffers.      */
+
+void stopDecoders(void)
+{
+	UINT16 i;
+
+	if (decoderCnt > 0)
+	{
+		discardFrames();
+
+		pthread_mutex_lock(&frameLock);
+		decodeStop = 1;
+		pthread_cond_broadcast(&frameQueued);
+		pthread_mutex_unlock(&frameLock);
+
+		for (i = 0; i < decoderCnt; i += 1)
+			pthread_join(decoders[i], NULL);
+
+		decoderCnt = 0;
+	}
+
+	for (i = 0; i < DECODE_FRAMES; i += 1)
+	{
+		free(frames[i].in);
+		free(frames[i].out);
+		frames[i].in = NULL;
+		frames[i].out = NULL;
+		frames[i].inAlloc = 0;
+		frames[i].outAlloc = 0;
+	}
+
+	return;
+}
+
+
+/* startDecoders() finds the decoder for the algorithm of the data set and    */
+/* starts a thread for each processor, the first time a compressed stream is  */
+/* read.                                                                      */
+
+static INT32 startDecoders(void)
+{
+	DECODER *ptr;
+	long cpus;
+
+	for (ptr = decoderTable; ptr->decode != NULL; ptr += 1)
+	{
+		if (ptr->id == setCompress)
+			break;
+	}
+
+	if (ptr->decode == NULL)
+	{
+		fprintf(stderr,
+		        "Software compression algorithm %u is not supported!\n",
+		        setCompress);
+		return(-1);
+	}
+
+	if ((decoder != ptr) && (verbose > 0))
+		fprintf(stdout, "Decompressing %s streams.\n", ptr->name);
+
+	decoder = ptr;
+
+	if (decoderCnt > 0)
+		return(0);
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1)
+		cpus = 1;
+	else if (cpus > MAX_DECODERS)
+		cpus = MAX_DECODERS;
+
+	decodeStop = 0;
+
+	while (decoderCnt < (UINT16) cpus)
+	{
+		if (pthread_create(&decoders[decoderCnt], NULL, decoderMain, NULL)
+		    != 0)
+		{
+			if (decoderCnt > 0)
+				break;
+
+			fprintf(stderr, "Unable to start decoder thread!\n");
+			return(-1);
+		}
+
+		decoderCnt += 1;
+	}
+
+	if (debug > 0) printf("%u decoder threads\n", decoderCnt);
+
+	return(0);
+}
+
+
+/* decoderMain() is run by each decoder thread. It decompresses queued frames */
+/* until the decoders are stopped.                                            */
+
+static void *decoderMain(void *arg)
+{
+	DECODE_FRAME *frame;
+	UINT16 i;
+
+	pthread_mutex_lock(&frameLock);
+
+	while (1)
+	{
+		frame = NULL;
+
+		for (i = 0; i < DECODE_FRAMES; i += 1)
+		{
+			if (frames[(frameTail + i) % DECODE_FRAMES].state == FRAME_QUEUED)
+			{
+				frame = &frames[(frameTail + i) % DECODE_FRAMES];
+				break;
+			}
+		}
+
+		if (frame == NULL)
+		{
+			if (decodeStop != 0)
+				break;
+
+			pthread_cond_wait(&frameQueued, &frameLock);
+			continue;
+		}
+
+		frame->state = FRAME_BUSY;
+		pthread_mutex_unlock(&frameLock);
+
+		frame->result = decoder->decode(frame->in, frame->inSize, frame->out,
+		                                frame->outSize);
+
+		pthread_mutex_lock(&frameLock);
+		frame->state = FRAME_DONE;
+		pthread_cond_broadcast(&frameDone);
+	}
+
+	pthread_mutex_unlock(&frameLock);
+
+	return(NULL);
+}
+
+
+/* takeStream() copies bytes of the stream being read, reading tape blocks as */
+/* needed.                                                                    */
+
+static INT32 takeStream(UINT8 *data, UINT32 bytes, UINT32 *offset,
+                        UINT64 *length)
+{
+	UINT32 chunk;
+
+	if ((length->most == 0) && (length->least < bytes))
+	{
+		fprintf(stderr, "Compressed stream is truncated!\n");
+		return(-1);
+	}
+
+	while (bytes > 0)
+	{
+		if (*offset >= remaining)
+		{
+			if (readNextBlock(0) != 0)
+			{
+				fprintf(stderr, "Error reading tape block!\n");
+				return(-1);
+			}
+
+			*offset = 0;
+		}
+
+		chunk = min(bytes, remaining - *offset);
+		memcpy(data, &tData[*offset], chunk);
+		sumData(&tData[*offset], chunk);
+
+		data += chunk;
+		bytes -= chunk;
+		*offset += chunk;
+		decrement64(length, chunk);
+	}
+
+	return(0);
+}
+
+
+/* putFrame() waits for the oldest frame to be decompressed and writes it.    */
+
+static INT32 putFrame(int file)
+{
+	DECODE_FRAME *frame;
+
+	frame = &frames[frameTail];
+
+	pthread_mutex_lock(&frameLock);
+
+	while (frame->state != FRAME_DONE)
+		pthread_cond_wait(&frameDone, &frameLock);
+
+	pthread_mutex_unlock(&frameLock);
+
+	if (frame->result != 0)
+	{
+		fprintf(stderr, "Error decompressing frame!\n");
+		return(-1);
+	}
+
+	if (putData(file, (frame->packed != 0) ? frame->out : frame->in,
+	            frame->outSize) != 0)
+	{
+		fprintf(stderr, "Error writing file!\n");
+		return(-1);
+	}
+
+	spendSpace(frame->outSize);
+
+	pthread_mutex_lock(&frameLock);
+
+	frame->state = FRAME_FREE;
+	frameTail = (frameTail + 1) % DECODE_FRAMES;
+
+	pthread_mutex_unlock(&frameLock);
+
+	framesPending -= 1;
+
+	return(0);
+}
+
+
+/* discardFrames() waits for the decoders to finish any frames left by a      */
+/* failed stream and drops them.                                              */
+
+static void discardFrames(void)
+{
+	UINT16 i;
+
+	pthread_mutex_lock(&frameLock);
+
+	for (i = 0; i < DECODE_FRAMES; i += 1)
+	{
+		while ((frames[i].state == FRAME_QUEUED) ||
+		       (frames[i].state == FRAME_BUSY))
+			pthread_cond_wait(&frameDone, &frameLock);
+
+		frames[i].state = FRAME_FREE;
+	}
+
+	frameTail = 0;
+
+	pthread_mutex_unlock(&frameLock);
+
+	frameHead = 0;
+	framesPending = 0;
+
+	return;
+}
+
+
+static INT32 growBuffer(UINT8 **buffer, UINT32 *size, UINT32 needed)
+{
+	UINT8 *ptr;
+
+	if (*size >= needed)
+		return(0);
+
+	ptr = (UINT8*) realloc(*buffer, max(needed, 1));
+	if (ptr == NULL)
+		return(-1);
+
+	*buffer = ptr;
+	*size = needed;
+
+	return(0);
+}
+
+
+#ifdef MTF_SOFT_LZS
+
+/* decodeLZS() decompresses a frame of Stac LZS (ANSI X3.241, as described in */
+/* RFC 1974). Each frame starts with an empty history, so frames can be       */
+/* decompressed independently.                                                */
+
+#define LZS_NEED(n) \
+	while (held < (n)) \
+	{ \
+		if (inPos >= inSize) \
+			return(-1); \
+		bits = (bits << 8) | in[inPos]; \
+		inPos += 1; \
+		held += 8; \
+	}
+
+#define LZS_TAKE(n, v) \
+	LZS_NEED(n); \
+	held -= (n); \
+	(v) = (bits >> held) & ((1UL << (n)) - 1);
+
+static INT32 decodeLZS(UINT8 *in, UINT32 inSize, UINT8 *out, UINT32 outSize)
+{
+	UINT32 bits, inPos, outPos, offset, length, value;
+	int held;
+
+	bits = 0;
+	held = 0;
+	inPos = 0;
+	outPos = 0;
+
+	while (outPos < outSize)
+	{
+		LZS_TAKE(1, value);
+
+		if (value == 0)
+		{
+			LZS_TAKE(8, value);
+			out[outPos] = (UINT8) value;
+			outPos += 1;
+			continue;
+		}
+
+		LZS_TAKE(1, value);
+
+		if (value == 1)
+		{
+			LZS_TAKE(7, offset);
+
+			if (offset == 0)
+				break;
+		}
+		else
+		{
+			LZS_TAKE(11, offset);
+		}
+
+		LZS_TAKE(2, value);
+
+		if (value < 3)
+		{
+			length = value + 2;
+		}
+		else
+		{
+			LZS_TAKE(2, value);
+
+			if (value < 3)
+			{
+				length = value + 5;
+			}
+			else
+			{
+				length = 8;
+
+				do
+				{
+					LZS_TAKE(4, value);
+					length += value;
+				} while (value == 15);
+			}
+		}
+
+		if ((offset == 0) || (offset > outPos) ||
+		    (length > outSize - outPos))
+			return(-1);
+
+		while (length > 0)
+		{
+			out[outPos] = out[outPos - offset];
+			outPos += 1;
+			length -= 1;
+		}
+	}
+
+	return((outPos == outSize) ? 0 : -1);
+}
+
+#endif /* MTF_SOFT_LZS */
@@ -0,0 +1,1279 @@
+/*
+
+mtf - a Microsoft Tape Format reader (and future writer?)
+Copyright (C) 1999  D. Alan Stewart, Layton Graphics, Inc.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+Contact the author at:
+
+D. Alan Stewart
+Layton Graphics, Inc.
+155 Woolco Dr.
+Marietta, GA 30062, USA
+astewart@layton-graphics.com
+
+See mtf.c for version history, contributors, etc.
+
+**
+**	mtfio.c
+**
+**	tape input functions; a reader thread keeps the drive streaming into a
+**	ring of tape block buffers while the rest of mtf parses and writes files,
+**	tape images on disk are mapped into memory and parsed in place, and
+**	inputs that allow it are read many tape blocks at a time
+**
+*/
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/mtio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <linux/fs.h>
+#include "mtf.h"
+
+
+extern int mtfd;
+extern UINT8 verbose, debug, asyncIO, asyncReads;
+extern UINT16 readAhead, flbSize;
+extern UINT32 readSize;
+extern size_t tapeBlockSize;
+
+
+typedef struct
+{
+	ssize_t	length;	/* bytes read, 0 for a filemark, -1 for an error */
+	int		error;	/* errno of a failed read */
+	size_t	pos;	/* bytes already handed out */
+	UINT8	*data;	/* tape blocks */
+} RING_SLOT;
+
+
+UINT8 readerRunning = 0;
+UINT8 tapeMapped = 0;
+UINT8 softMarks = 0;
+
+static RING_SLOT *ring = NULL;
+static UINT8 *ringData = NULL;
+static UINT16 ringSlots, ringHead, ringTail, ringCount;
+static UINT8 ringStop, ringDone;
+static pthread_t reader;
+static pthread_mutex_t ringLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ringFilled = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t ringDrained = PTHREAD_COND_INITIALIZER;
+static UINT8 *tapeMap = NULL;
+static size_t mapSize, mapPos;
+static UINT8 *chunk = NULL;
+static size_t chunkSize = 0, chunkMax = 0, chunkLen = 0, chunkPos = 0;
+static UINT16 tuneLeft = 0;
+static double tuneRate;
+static UINT8 copyUnsupported = 0;
+static unsigned long long *marks = NULL;
+static size_t markCnt = 0, markMax = 0;
+static unsigned long long marksKnown = 0;
+static UINT8 lastMarkRead = 0;
+static UINT8 *markBuffer = NULL;
+static unsigned long long readOffset = 0;
+
+
+static ssize_t readBlocks(UINT8**, size_t);
+static void *readerMain(void*);
+static ssize_t readChunk(UINT8*);
+static INT32 tapePosition(unsigned long long*);
+static INT32 endOfTape(unsigned long long*);
+static INT32 seekBlock(unsigned long long);
+static INT32 forwardMarks(unsigned long long*, int);
+static INT32 backMarks(unsigned long long*, int);
+static INT32 findLastMark(void);
+static ssize_t readMarkBlock(unsigned long long, UINT8**);
+static INT32 scanMarks(unsigned long long, unsigned long long*);
+static void addMarks(unsigned long long, UINT8*, size_t);
+static void addMark(unsigned long long);
+
+
+/* mapTape() maps the input into memory if it is a regular file, such as a   */
+/* dd image of a tape. Descriptor blocks are then parsed and file data is     */
+/* written straight from the mapping. If the input is not a regular file or   */
+/* cannot be mapped it is read normally.                                      */
+
+INT32 mapTape(void)
+{
+	struct stat sbuf;
+
+	if (fstat(mtfd, &sbuf) != 0)
+	{
+		fprintf(stderr, "Error %d testing for status of tape!\n", errno);
+		return(-1);
+	}
+
+	if ((!S_ISREG(sbuf.st_mode)) || (sbuf.st_size == 0))
+		return(0);
+
+	tapeMap = (UINT8*) mmap(NULL, (size_t) sbuf.st_size, PROT_READ, MAP_SHARED,
+	                        mtfd, 0);
+	if (tapeMap == MAP_FAILED)
+	{
+		if (verbose > 0)
+			fprintf(stdout, "Unable to map tape image, reading it instead.\n");
+
+		tapeMap = NULL;
+		return(0);
+	}
+
+	madvise(tapeMap, (size_t) sbuf.st_size, MADV_SEQUENTIAL);
+
+	mapSize = (size_t) sbuf.st_size;
+	mapPos = 0;
+	tapeMapped = 1;
+
+	if (verbose > 1)
+		fprintf(stdout, "Tape image of %lu bytes mapped into memory.\n",
+		        (UINT32) mapSize);
+
+	return(0);
+}
+
+
+/* unmapTape() releases the mapping made by mapTape(), the buffer used by     */
+/* multi-block reads and the soft filemark addresses.                         */
+
+void unmapTape(void)
+{
+	free(chunk);
+	chunk = NULL;
+	chunkSize = 0;
+
+	free(marks);
+	marks = NULL;
+	markCnt = 0;
+	markMax = 0;
+	free(markBuffer);
+	markBuffer = NULL;
+
+	if (tapeMapped == 0)
+		return;
+
+	munmap(tapeMap, mapSize);
+	tapeMap = NULL;
+	tapeMapped = 0;
+
+	return;
+}
+
+
+/* tapeImage() returns the mapping made by mapTape() and its length, or NULL */
+/* if the input is not mapped.                                                */
+
+UINT8 *tapeImage(size_t *length)
+{
+	if (tapeMapped == 0)
+		return(NULL);
+
+	*length = mapSize;
+
+	return(tapeMap);
+}
+
+
+/* calibrateReads() decides, once the tape block size is known, how many     */
+/* bytes to ask for with each read(). Tape images and drives in fixed block   */
+/* mode return as many whole blocks as are asked for (stopping short at a     */
+/* filemark), so they are read readSize bytes at a time. If no read size was  */
+/* given the first reads start small and the size is doubled, up to          */
+/* AUTO_READ_SIZE, for as long as the transfer rate keeps improving. Drives   */
+/* in variable block mode return one block per read() and are left alone.     */
+
+INT32 calibrateReads(void)
+{
+	struct stat sbuf;
+	struct mtget get;
+	UINT8 multi;
+
+	if ((tapeMapped != 0) || (tapeBlockSize == 0))
+		return(0);
+
+	if (fstat(mtfd, &sbuf) != 0)
+	{
+		fprintf(stderr, "Error %d testing for status of tape!\n", errno);
+		return(-1);
+	}
+
+	multi = 0;
+
+	if (S_ISREG(sbuf.st_mode))
+		multi = 1;
+	else if ((ioctl(mtfd, MTIOCGET, &get) == 0) &&
+	         (((get.mt_dsreg & MT_ST_BLKSIZE_MASK) >> MT_ST_BLKSIZE_SHIFT) != 0))
+		multi = 1;
+
+	if (multi == 0)
+	{
+		if ((verbose > 1) && (readSize != 0))
+			fprintf(stdout, "Tape is in variable block mode, "
+			        "reading one block at a time.\n");
+
+		return(0);
+	}
+
+	if (readSize != 0)
+	{
+		chunkMax = max(readSize - readSize % tapeBlockSize, tapeBlockSize);
+		chunkSize = chunkMax;
+		tuneLeft = 0;
+	}
+	else
+	{
+		chunkMax = max(AUTO_READ_SIZE - AUTO_READ_SIZE % tapeBlockSize,
+		               tapeBlockSize);
+		chunkSize = max(MAX_TAPE_BLOCK_SIZE -
+		                MAX_TAPE_BLOCK_SIZE % tapeBlockSize, tapeBlockSize);
+		chunkSize = min(chunkSize, chunkMax);
+		tuneLeft = MAX_TUNE_READS;
+		tuneRate = 0.0;
+	}
+
+	if (chunkMax <= tapeBlockSize)
+	{
+		chunkSize = 0;
+		chunkMax = 0;
+		return(0);
+	}
+
+	chunk = (UINT8*) malloc(chunkMax);
+	if (chunk == NULL)
+	{
+		fprintf(stderr, "Unable to allocate read buffer!\n");
+		chunkSize = 0;
+		chunkMax = 0;
+		return(-1);
+	}
+
+	chunkLen = 0;
+	chunkPos = 0;
+
+	if ((verbose > 1) && (tuneLeft == 0))
+		fprintf(stdout, "Reading %lu bytes at a time.\n", (UINT32) chunkSize);
+
+	return(0);
+}
+
+
+/* positionTape() performs a tape operation such as spacing over filemarks,  */
+/* first discarding any tape blocks that were read but not yet used. On media */
+/* written with soft filemarks there are no filemarks to space over, so the   */
+/* operation is carried out by seeking to the SFMB blocks standing in for     */
+/* them instead. This also works for tape images, which have no ioctls.       */
+
+INT32 positionTape(struct mtop *op)
+{
+	unsigned long long block;
+
+	if ((softMarks == 0) ||
+	    ((op->mt_op != MTREW) && (op->mt_op != MTEOM) &&
+	     (op->mt_op != MTFSF) && (op->mt_op != MTBSF)))
+	{
+		chunkLen = 0;
+		chunkPos = 0;
+
+		return(ioctl(mtfd, MTIOCTOP, op));
+	}
+
+	if (tapePosition(&block) != 0)
+		return(-1);
+
+	switch (op->mt_op)
+	{
+		case MTREW:
+			block = 0;
+			break;
+
+		case MTEOM:
+			if (endOfTape(&block) != 0)
+				return(-1);
+			break;
+
+		case MTFSF:
+			if (forwardMarks(&block, op->mt_count) != 0)
+				return(-1);
+			break;
+
+		case MTBSF:
+			if (backMarks(&block, op->mt_count) != 0)
+				return(-1);
+			break;
+	}
+
+	if (debug > 0) printf("soft positioning to block %llu\n", block);
+
+	return(seekBlock(block));
+}
+
+
+/* seekTape() positions the tape at a physical block address, counted in tape */
+/* blocks from the start of the tape. Drives are positioned with MTSEEK; tape */
+/* images are simply read from the block's offset. Nothing may be reading    */
+/* ahead.                                                                     */
+
+INT32 seekTape(UINT64 *pba)
+{
+	struct stat sbuf;
+	struct mtop op;
+	unsigned long long block;
+
+	if ((readerRunning != 0) || (asyncReads != 0))
+	{
+		fprintf(stderr, "Unable to seek while reading ahead!\n");
+		return(-1);
+	}
+
+	block = ((unsigned long long) pba->most << 32) +
+	        (unsigned long long) pba->least;
+
+	if ((tapeMapped != 0) ||
+	    ((fstat(mtfd, &sbuf) == 0) && (S_ISREG(sbuf.st_mode))))
+		return(seekOffset(block * tapeBlockSize));
+
+	chunkLen = 0;
+	chunkPos = 0;
+
+	if (block > 0x7FFFFFFFULL)
+	{
+		fprintf(stderr, "Block %llu is out of range for MTSEEK!\n", block);
+		return(-1);
+	}
+
+	op.mt_op = MTSEEK;
+	op.mt_count = (int) block;
+
+	if (ioctl(mtfd, MTIOCTOP, &op) != 0)
+	{
+		fprintf(stderr, "Error %d seeking to block %llu!\n", errno, block);
+		return(-1);
+	}
+
+	return(0);
+}
+
+
+/* seekOffset() positions a tape image at offset bytes from its start.       */
+/* Nothing may be reading ahead.                                              */
+
+INT32 seekOffset(unsigned long long offset)
+{
+	if ((readerRunning != 0) || (asyncReads != 0))
+	{
+		fprintf(stderr, "Unable to seek while reading ahead!\n");
+		return(-1);
+	}
+
+	chunkLen = 0;
+	chunkPos = 0;
+
+	if (tapeMapped != 0)
+	{
+		if (offset > mapSize)
+		{
+			fprintf(stderr, "Offset %llu is past the end of the tape image!\n",
+			        offset);
+			return(-1);
+		}
+
+		mapPos = (size_t) offset;
+	}
+	else if (lseek(mtfd, (off_t) offset, SEEK_SET) == -1)
+	{
+		fprintf(stderr, "Error %d seeking in tape image!\n", errno);
+		return(-1);
+	}
+
+	readOffset = offset;
+
+	return(0);
+}
+
+
+/* tapeOffset() returns how many bytes readTape() has handed out since the    */
+/* start of the tape or the last seek, which in a tape image is the offset of */
+/* the next byte to be read.                                                  */
+
+unsigned long long tapeOffset(void)
+{
+	return(readOffset);
+}
+
+
+/* tapeUnit() returns the size of the units that positions on the tape are    */
+/* counted in: 1 for a tape image, whose tape blocks are unknown once copied  */
+/* to disk, and otherwise the drive's block size. A drive in variable block   */
+/* mode returns one block per read, so that is the size of the first read.    */
+
+size_t tapeUnit(void)
+{
+	struct stat sbuf;
+	struct mtget get;
+
+	if ((tapeMapped != 0) ||
+	    ((fstat(mtfd, &sbuf) == 0) && (S_ISREG(sbuf.st_mode))))
+		return(1);
+
+	if ((ioctl(mtfd, MTIOCGET, &get) == 0) &&
+	    (((get.mt_dsreg & MT_ST_BLKSIZE_MASK) >> MT_ST_BLKSIZE_SHIFT) != 0))
+		return((get.mt_dsreg & MT_ST_BLKSIZE_MASK) >> MT_ST_BLKSIZE_SHIFT);
+
+	return(tapeBlockSize);
+}
+
+
+/* isSoftMark() returns 1 if data, length bytes of it read, is an SFMB block. */
+/* Since the block takes the place of a filemark its header checksum is      */
+/* always checked, so that file data is never mistaken for one.              */
+
+INT32 isSoftMark(UINT8 *data, size_t length)
+{
+	MTF_DB_HDR *hdr;
+
+	hdr = (MTF_DB_HDR*) data;
+
+	if ((length < sizeof(MTF_SFMB_BLK)) || (hdr->type != MTF_SFMB))
+		return(0);
+
+	return(headerSum(hdr, sizeof(MTF_DB_HDR) - sizeof(UINT16)) == hdr->check);
+}
+
+
+/* noteSoftMarks() records the filemark addresses in the table of an SFMB     */
+/* block read from the tape. length is the number of bytes read from its     */
+/* start, which end with the last tape block holding it.                      */
+
+void noteSoftMarks(UINT8 *data, size_t length)
+{
+	unsigned long long block;
+
+	if (tapePosition(&block) != 0)
+	{
+		addMarks(0, data, length);
+		return;
+	}
+
+	addMarks(block - length / tapeBlockSize, data, length);
+
+	return;
+}
+
+
+static INT32 tapePosition(unsigned long long *block)
+{
+	struct stat sbuf;
+	struct mtpos pos;
+	off_t offset;
+
+	if ((readerRunning != 0) || (asyncReads != 0))
+		return(-1);
+
+	if (tapeMapped != 0)
+	{
+		*block = mapPos / tapeBlockSize;
+		return(0);
+	}
+
+	if ((fstat(mtfd, &sbuf) == 0) && (S_ISREG(sbuf.st_mode)))
+	{
+		offset = lseek(mtfd, 0, SEEK_CUR);
+		if (offset == -1)
+			return(-1);
+
+		*block = (unsigned long long) offset / tapeBlockSize;
+	}
+	else
+	{
+		if (ioctl(mtfd, MTIOCPOS, &pos) != 0)
+			return(-1);
+
+		*block = (unsigned long long) pos.mt_blkno;
+	}
+
+	*block -= (chunkLen - chunkPos) / tapeBlockSize;
+
+	return(0);
+}
+
+
+static INT32 endOfTape(unsigned long long *block)
+{
+	struct stat sbuf;
+	struct mtop op;
+
+	if (tapeMapped != 0)
+	{
+		*block = mapSize / tapeBlockSize;
+		return(0);
+	}
+
+	if (fstat(mtfd, &sbuf) != 0)
+		return(-1);
+
+	if (S_ISREG(sbuf.st_mode))
+	{
+		*block = (unsigned long long) sbuf.st_size / tapeBlockSize;
+		return(0);
+	}
+
+	op.mt_op = MTEOM;
+	op.mt_count = 1;
+
+	chunkLen = 0;
+	chunkPos = 0;
+
+	if (ioctl(mtfd, MTIOCTOP, &op) != 0)
+		return(-1);
+
+	return(tapePosition(block));
+}
+
+
+static INT32 seekBlock(unsigned long long block)
+{
+	UINT64 pba;
+
+	pba.least = (UINT32) (block & 0xFFFFFFFFULL);
+	pba.most = (UINT32) (block >> 32);
+
+	return(seekTape(&pba));
+}
+
+
+/* forwardMarks() moves block past count soft filemarks. Those whose         */
+/* addresses are not yet known are looked up in the table of the last SFMB   */
+/* block on the tape, or failing that found by reading the tape.              */
+
+static INT32 forwardMarks(unsigned long long *block, int count)
+{
+	unsigned long long next;
+	size_t i;
+
+	while (count > 0)
+	{
+		for (i = 0; (i < markCnt) && (marks[i] < *block); i += 1)
+			;
+
+		if ((i < markCnt) && (marks[i] < marksKnown))
+		{
+			next = marks[i];
+		}
+		else if (lastMarkRead == 0)
+		{
+			if (findLastMark() != 0)
+				return(-1);
+
+			continue;
+		}
+		else if (scanMarks(max(*block, marksKnown), &next) != 0)
+		{
+			return(-1);
+		}
+
+		*block = next + max((flbSize + tapeBlockSize - 1) / tapeBlockSize, 1);
+		count -= 1;
+	}
+
+	return(0);
+}
+
+
+/* backMarks() moves block back to the count-th soft filemark before it, so  */
+/* that it is the next thing read, as MTBSF does.                             */
+
+static INT32 backMarks(unsigned long long *block, int count)
+{
+	unsigned long long next;
+	size_t i;
+	INT32 result;
+
+	if ((lastMarkRead == 0) && (*block > marksKnown) && (findLastMark() != 0))
+		return(-1);
+
+	while (*block > marksKnown)
+	{
+		result = scanMarks(marksKnown, &next);
+		if (result < 0)
+			return(-1);
+
+		if ((result > 0) || (next >= *block))
+			break;
+	}
+
+	for (i = markCnt; (i > 0) && (marks[i - 1] >= *block); i -= 1)
+		;
+
+	if (i < (size_t) count)
+	{
+		*block = 0;
+		return(-1);
+	}
+
+	*block = marks[i - count];
+
+	return(0);
+}
+
+
+/* findLastMark() reads the table of the last SFMB block on the tape, which  */
+/* lists the soft filemarks written before it. It is looked for in the last   */
+/* SOFT_MARK_SCAN tape blocks. If its table is full, the table of the oldest  */
+/* soft filemark in it is read next, and so on back to the start of the tape. */
+
+static INT32 findLastMark(void)
+{
+	unsigned long long end, block, last, from;
+	ssize_t result;
+	UINT8 *data;
+	size_t i;
+
+	lastMarkRead = 1;
+	result = 0;
+
+	if (endOfTape(&end) != 0)
+		return(-1);
+
+	for (block = end; (block > 0) && (end - block < SOFT_MARK_SCAN); block -= 1)
+	{
+		result = readMarkBlock(block - 1, &data);
+		if (result < 0)
+			return(-1);
+
+		if (isSoftMark(data, (size_t) result) != 0)
+			break;
+	}
+
+	if ((block == 0) || (end - block >= SOFT_MARK_SCAN))
+		return(0);
+
+	last = block - 1;
+
+	if (verbose > 0)
+		fprintf(stdout, "Found last soft filemark at block %llu.\n", last);
+
+	addMarks(last, data, (size_t) result);
+
+	from = last;
+
+	while (marksKnown <= from)
+	{
+		for (i = 0; (i < markCnt) && (marks[i] < marksKnown); i += 1)
+			;
+
+		if ((i == markCnt) || (marks[i] >= from))
+			break;
+
+		from = marks[i];
+
+		result = readMarkBlock(from, &data);
+		if (result < 0)
+			return(-1);
+
+		if (isSoftMark(data, (size_t) result) == 0)
+			break;
+
+		addMarks(from, data, (size_t) result);
+	}
+
+	/* the tables read list every soft filemark from there to the last */
+	if (marksKnown > from)
+		marksKnown = max(marksKnown, last + 1);
+
+	return(0);
+}
+
+
+/* readMarkBlock() points data at the tape block at block and returns its     */
+/* length.                                                                    */
+
+static ssize_t readMarkBlock(unsigned long long block, UINT8 **data)
+{
+	if (tapeMapped != 0)
+	{
+		if (block * tapeBlockSize >= mapSize)
+			return(0);
+
+		*data = &tapeMap[block * tapeBlockSize];
+		return((ssize_t) min(tapeBlockSize, mapSize - block * tapeBlockSize));
+	}
+
+	if (markBuffer == NULL)
+	{
+		markBuffer = (UINT8*) malloc(tapeBlockSize);
+		if (markBuffer == NULL)
+		{
+			fprintf(stderr, "Unable to allocate soft filemark buffer!\n");
+			return(-1);
+		}
+	}
+
+	if (seekBlock(block) != 0)
+		return(-1);
+
+	*data = markBuffer;
+
+	return(read(mtfd, markBuffer, tapeBlockSize));
+}
+
+
+/* scanMarks() reads the tape from block on to the next SFMB block, for when  */
+/* the address of a soft filemark cannot be found any other way. It returns   */
+/* 1 if the end of the tape is reached first.                                 */
+
+static INT32 scanMarks(unsigned long long block, unsigned long long *found)
+{
+	unsigned long long start;
+	ssize_t result;
+	UINT8 *data;
+
+	if (verbose > 0)
+		fprintf(stdout, "Reading tape for soft filemark from block %llu...\n",
+		        block);
+
+	start = block;
+
+	result = readMarkBlock(block, &data);
+
+	while (1)
+	{
+		if (result < 0)
+			return(-1);
+		else if (result == 0)
+			return(1);
+
+		if (isSoftMark(data, (size_t) result) != 0)
+		{
+			addMarks(block, data, (size_t) result);
+
+			/* every block from start on has been looked at */
+			if (start <= marksKnown)
+				marksKnown = max(marksKnown, block + 1);
+
+			*found = block;
+			return(0);
+		}
+
+		block += 1;
+
+		if (tapeMapped != 0)
+			result = readMarkBlock(block, &data);
+		else
+			result = read(mtfd, data, tapeBlockSize);
+	}
+}
+
+
+/* addMarks() records the address of the SFMB block at block, if known, and   */
+/* the addresses in its table, newest first. Unless the table is full it      */
+/* lists every soft filemark before the block, so all addresses up to it are  */
+/* then known.                                                                */
+
+static void addMarks(unsigned long long block, UINT8 *data, size_t length)
+{
+	MTF_SFMB_BLK *sfmb;
+	UINT32 *table, used, i;
+	unsigned long long oldest, newest;
+
+	sfmb = (MTF_SFMB_BLK*) data;
+	table = (UINT32*) &data[sizeof(MTF_SFMB_BLK)];
+
+	used = min(sfmb->used, sfmb->marks);
+	used = min(used, (length - sizeof(MTF_SFMB_BLK)) / sizeof(UINT32));
+
+	if (block != 0)
+		addMark(block);
+
+	oldest = (block != 0) ? block : ~0ULL;
+	newest = block;
+
+	for (i = 0; i < used; i += 1)
+	{
+		addMark(table[i]);
+
+		oldest = min(oldest, (unsigned long long) table[i]);
+		newest = max(newest, (unsigned long long) table[i]);
+	}
+
+	if ((used < sfmb->marks) || (oldest <= marksKnown))
+		marksKnown = max(marksKnown, newest + 1);
+
+	if (debug > 0)
+		printf("%lu soft filemarks known, all before block %llu\n",
+		       (UINT32) markCnt, marksKnown);
+
+	return;
+}
+
+
+static void addMark(unsigned long long block)
+{
+	unsigned long long *more;
+	size_t i;
+
+	for (i = markCnt; (i > 0) && (marks[i - 1] > block); i -= 1)
+		;
+
+	if ((i > 0) && (marks[i - 1] == block))
+		return;
+
+	if (markCnt == markMax)
+	{
+		more = (unsigned long long*) realloc(marks, (markMax + 64) *
+		                                     sizeof(unsigned long long));
+		if (more == NULL)
+			return;
+
+		marks = more;
+		markMax += 64;
+	}
+
+	memmove(&marks[i + 1], &marks[i], (markCnt - i) *
+	        sizeof(unsigned long long));
+	marks[i] = block;
+	markCnt += 1;
+
+	return;
+}
+
+
+/* copyTape() copies file data straight from a mapped tape image to a file,   */
+/* so that it never passes through user space. Whole filesystem blocks are    */
+/* cloned if the data happens to be aligned and the filesystem can share      */
+/* extents (btrfs, XFS); the rest is handed to copy_file_range(). It returns  */
+/* 1, having written nothing, if the data has to be written normally.         */
+
+INT32 copyTape(int file, UINT8 *data, UINT64 *length)
+{
+	off_t pos, total, done, in;
+	ssize_t result;
+#ifdef FICLONERANGE
+	struct stat sbuf;
+	struct file_clone_range clone;
+	off_t out;
+#endif
+
+	if ((tapeMapped == 0) || (copyUnsupported != 0))
+		return(1);
+
+	if ((data < tapeMap) || (data >= tapeMap + mapSize))
+		return(1);
+
+	pos = (off_t) (data - tapeMap);
+	total = ((off_t) length->most << 32) + (off_t) length->least;
+
+	if (total > (off_t) mapSize - pos)
+		return(1);
+
+	done = 0;
+
+#ifdef FICLONERANGE
+	out = lseek(file, 0, SEEK_CUR);
+
+	if ((out != -1) && (fstat(file, &sbuf) == 0) && (sbuf.st_blksize > 0) &&
+	    ((pos % sbuf.st_blksize) == 0) && ((out % sbuf.st_blksize) == 0) &&
+	    (total >= sbuf.st_blksize))
+	{
+		clone.src_fd = mtfd;
+		clone.src_offset = pos;
+		clone.src_length = total - (total % sbuf.st_blksize);
+		clone.dest_offset = out;
+
+		if (ioctl(file, FICLONERANGE, &clone) == 0)
+		{
+			done = clone.src_length;
+			lseek(file, out + done, SEEK_SET);
+
+			if (debug > 0) printf("cloned %ld bytes\n", (long) done);
+		}
+	}
+#endif
+
+	while (done < total)
+	{
+		in = pos + done;
+
+		result = copy_file_range(mtfd, &in, file, NULL, total - done, 0);
+		if (result > 0)
+		{
+			done += result;
+			continue;
+		}
+
+		if ((result < 0) && (errno != EXDEV) && (errno != EINVAL) &&
+		    (errno != ENOSYS) && (errno != EOPNOTSUPP))
+		{
+			fprintf(stderr, "Error %d copying file data!\n", errno);
+			return(-1);
+		}
+
+		if ((result < 0) && (done == 0))
+		{
+			if (debug > 0) printf("copy_file_range() unsupported\n");
+
+			copyUnsupported = 1;
+			return(1);
+		}
+
+		/* what could not be copied is written from the mapping */
+		result = write(file, &data[done], total - done);
+		if (result < 0)
+		{
+			fprintf(stderr, "Error %d writing file data!\n", errno);
+			return(-1);
+		}
+		else if (result == 0)
+		{
+			fprintf(stderr, "Error writing file data!\n");
+			return(-1);
+		}
+
+		done += result;
+	}
+
+	return(0);
+}
+
+
+/* startReader() allocates the ring of tape block buffers and starts the      */
+/* reader thread. The tape block size must be known by the time this is       */
+/* called. Nothing is started if read-ahead has been disabled or the tape is  */
+/* mapped into memory. With multi-block reads each slot of the ring holds one */
+/* read's worth of blocks; there are as many slots as it takes to hold        */
+/* readAhead tape blocks, but never fewer than two. With asynchronous I/O the */
+/* same slots are read ahead through io_uring instead of by a thread.         */
+
+INT32 startReader(void)
+{
+	UINT16 i;
+	size_t slotSize;
+
+	if ((readAhead == 0) || (readerRunning != 0) || (tapeMapped != 0))
+		return(0);
+
+	if (chunkSize != 0)
+	{
+		slotSize = chunkMax;
+		ringSlots = (UINT16) max((readAhead * tapeBlockSize) / slotSize, 2);
+	}
+	else
+	{
+		slotSize = tapeBlockSize;
+		ringSlots = readAhead;
+	}
+
+	if (asyncIO != 0)
+		return(startAsyncReads(slotSize, ringSlots));
+
+	ring = (RING_SLOT*) malloc(sizeof(RING_SLOT) * ringSlots);
+	ringData = (UINT8*) malloc(slotSize * ringSlots);
+	if ((ring == NULL) || (ringData == NULL))
+	{
+		fprintf(stderr, "Unable to allocate read-ahead buffers!\n");
+		free(ring);
+		free(ringData);
+		ring = NULL;
+		ringData = NULL;
+		return(-1);
+	}
+
+	for (i = 0; i < ringSlots; i += 1)
+		ring[i].data = &ringData[slotSize * i];
+
+	ringHead = 0;
+	ringTail = 0;
+	ringCount = 0;
+	ringStop = 0;
+	ringDone = 0;
+
+	if (chunkLen > chunkPos)
+	{
+		/* hand blocks already read on to the ring */
+		ring[0].length = chunkLen - chunkPos;
+		ring[0].error = 0;
+		ring[0].pos = 0;
+		memcpy(ring[0].data, &chunk[chunkPos], chunkLen - chunkPos);
+		ringHead = 1;
+		ringCount = 1;
+		chunkLen = 0;
+		chunkPos = 0;
+	}
+
+	if (pthread_create(&reader, NULL, readerMain, NULL) != 0)
+	{
+		fprintf(stderr, "Unable to start tape reader thread!\n");
+		free(ring);
+		free(ringData);
+		ring = NULL;
+		ringData = NULL;
+		return(-1);
+	}
+
+	readerRunning = 1;
+
+	return(0);
+}
+
+
+/* stopReader() stops reading ahead: it tells the reader thread to quit,      */
+/* waits for it and releases the ring, or stops the reads made by io_uring.   */
+/* Any tape blocks read ahead but not consumed are discarded.                 */
+
+void stopReader(void)
+{
+	stopAsyncReads();
+
+	if (readerRunning == 0)
+		return;
+
+	pthread_mutex_lock(&ringLock);
+	ringStop = 1;
+	pthread_cond_broadcast(&ringDrained);
+	pthread_mutex_unlock(&ringLock);
+
+	pthread_join(reader, NULL);
+
+	free(ring);
+	free(ringData);
+	ring = NULL;
+	ringData = NULL;
+	readerRunning = 0;
+
+	return;
+}
+
+
+/* readTape() returns the next tape block just as read() would: the number of */
+/* bytes read, 0 for a filemark or -1 for an error. The block is read into    */
+/* the buffer pointed to by *buffer. When the tape is mapped, *buffer is      */
+/* instead pointed at the block in the mapping; successive blocks are         */
+/* contiguous there, so a block asked for at the end of the previous one is   */
+/* already in place. When the reader thread or io_uring is reading ahead the  */
+/* block comes from there, otherwise the tape is read directly. With          */
+/* multi-block reads the blocks of each read are handed out one at a time.    */
+
+ssize_t readTape(UINT8 **buffer, size_t size)
+{
+	ssize_t result;
+
+	result = readBlocks(buffer, size);
+	if (result > 0)
+		readOffset += result;
+
+	return(result);
+}
+
+
+/* readBlocks() does the work of readTape() for whichever way the tape is     */
+/* being read.                                                                */
+
+static ssize_t readBlocks(UINT8 **buffer, size_t size)
+{
+	ssize_t result;
+	RING_SLOT *slot;
+
+	if (tapeMapped != 0)
+	{
+		result = (ssize_t) min(size, mapSize - mapPos);
+		*buffer = &tapeMap[mapPos];
+		mapPos += result;
+
+		return(result);
+	}
+
+	if ((asyncReads != 0) && (chunkPos == chunkLen))
+		return(readAsync(*buffer, size));
+
+	if (readerRunning == 0)
+	{
+		if (chunkSize == 0)
+			return(read(mtfd, *buffer, size));
+
+		if (chunkPos == chunkLen)
+		{
+			result = readChunk(chunk);
+			if (result <= 0)
+			{
+				chunkLen = 0;
+				chunkPos = 0;
+				return(result);
+			}
+
+			chunkLen = (size_t) result;
+			chunkPos = 0;
+		}
+
+		result = (ssize_t) min(size, chunkLen - chunkPos);
+		memcpy(*buffer, &chunk[chunkPos], result);
+		chunkPos += result;
+
+		return(result);
+	}
+
+	pthread_mutex_lock(&ringLock);
+
+	while ((ringCount == 0) && (ringDone == 0))
+		pthread_cond_wait(&ringFilled, &ringLock);
+
+	if (ringCount == 0)
+	{
+		/* the reader has quit; repeat whatever stopped it */
+		slot = &ring[(ringTail + ringSlots - 1) % ringSlots];
+		result = slot->length;
+		errno = slot->error;
+		pthread_mutex_unlock(&ringLock);
+
+		return(result);
+	}
+
+	slot = &ring[ringTail];
+	pthread_mutex_unlock(&ringLock);
+
+	result = slot->length;
+	if (result > 0)
+	{
+		result = (ssize_t) min((size_t) result - slot->pos, size);
+		memcpy(*buffer, &slot->data[slot->pos], result);
+		slot->pos += result;
+
+		if (slot->pos < (size_t) slot->length)
+			return(result);
+	}
+	else if (result < 0)
+	{
+		errno = slot->error;
+	}
+
+	pthread_mutex_lock(&ringLock);
+	ringTail = (ringTail + 1) % ringSlots;
+	ringCount -= 1;
+	pthread_cond_signal(&ringDrained);
+	pthread_mutex_unlock(&ringLock);
+
+	return(result);
+}
+
+
+/* readChunk() reads the next tape block, or the next chunkSize bytes of tape */
+/* blocks with multi-block reads. While the read size is being tuned it times */
+/* each read and doubles the size as long as the transfer rate improves.      */
+
+static ssize_t readChunk(UINT8 *buffer)
+{
+	ssize_t result;
+	size_t size;
+	struct timeval start, end;
+	double rate;
+
+	if (chunkSize == 0)
+		return(read(mtfd, buffer, tapeBlockSize));
+
+	size = chunkSize;
+
+	if (tuneLeft > 0)
+		gettimeofday(&start, NULL);
+
+	result = read(mtfd, buffer, size);
+
+	if ((tuneLeft > 0) && (result == (ssize_t) size))
+	{
+		gettimeofday(&end, NULL);
+
+		rate = (double) result / (double) ((end.tv_sec - start.tv_sec) *
+		       1000000 + (end.tv_usec - start.tv_usec) + 1);
+
+		if ((rate > tuneRate * TUNE_GAIN) && (chunkSize * 2 <= chunkMax))
+		{
+			tuneRate = rate;
+			chunkSize *= 2;
+			tuneLeft -= 1;
+		}
+		else
+		{
+			tuneLeft = 0;
+		}
+
+		if ((verbose > 1) && (tuneLeft == 0))
+			fprintf(stdout, "Reading %lu bytes at a time.\n",
+			        (UINT32) chunkSize);
+	}
+
+	return(result);
+}
+
+
+/* readerMain() is the body of the reader thread. It fills the ring until the */
+/* end of recorded data (two filemarks in a row), a read error or a request   */
+/* to stop.                                                                   */
+
+static void *readerMain(void *arg)
+{
+	RING_SLOT *slot;
+	UINT8 marked;
+
+	marked = 0;
+
+	pthread_mutex_lock(&ringLock);
+
+	while (ringStop == 0)
+	{
+		while ((ringCount == ringSlots) && (ringStop == 0))
+			pthread_cond_wait(&ringDrained, &ringLock);
+
+		if (ringStop != 0)
+			break;
+
+		slot = &ring[ringHead];
+		pthread_mutex_unlock(&ringLock);
+
+		slot->length = readChunk(slot->data);
+		slot->error = errno;
+		slot->pos = 0;
+
+		if (slot->length == 0)
+			marked += 1;
+		else
+			marked = 0;
+
+		if ((debug > 0) && (slot->length <= 0))
+			printf("reader thread read %ld\n", (long) slot->length);
+
+		pthread_mutex_lock(&ringLock);
+		ringHead = (ringHead + 1) % ringSlots;
+		ringCount += 1;
+		pthread_cond_signal(&ringFilled);
+
+		if ((slot->length < 0) || (marked > 1))
+			break;
+	}
+
+	ringDone = 1;
+	pthread_cond_broadcast(&ringFilled);
+	pthread_mutex_unlock(&ringLock);
+
+	return(NULL);
+}
@@ -0,0 +1,1113 @@
+/*
+
+mtf - a Microsoft Tape Format reader (and future writer?)
+Copyright (C) 1999  D. Alan Stewart, Layton Graphics, Inc.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+Contact the author at:
+
+D. Alan Stewart
+Layton Graphics, Inc.
+155 Woolco Dr.
+Marietta, GA 30062, USA
+astewart@layton-graphics.com
+
+See mtf.c for version history, contributors, etc.
+
+**
+**	mtfmatch.c
+**
+**	functions for matching file paths against the patterns given, with the
+**	patterns prefiltered by one automaton built from their literal text
+**
+*/
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <strings.h>
+#include <ctype.h>
+#include <regex.h>
+#include <fnmatch.h>
+#include "mtf.h"
+
+
+extern UINT8 verbose, debug;
+extern UINT16 matchCnt;
+
+
+typedef struct
+{
+	char	*text;		/* pattern as given */
+	UINT8	glob;		/* shell glob rather than regex */
+	regex_t	regex;		/* compiled regex */
+	char	*literal;	/* lower case text every match contains, or NULL */
+	char	*prefix;	/* text every match starts with, or NULL */
+	INT32	same;		/* next pattern with the same literal */
+	UINT32	seen;		/* last path it was a candidate for */
+} PATTERN;
+
+
+typedef struct
+{
+	char	*path;		/* as listed, without a leading slash */
+	size_t	length;		/* of path, or of the directory part of it */
+	UINT8	found;		/* a file with this path was read */
+} LISTED;
+
+
+UINT8 selecting = 0;
+UINT32 listCnt = 0;
+
+
+static PATTERN *patterns = NULL;
+static UINT32 patternAlloc = 0;
+static UINT32 *candidates = NULL;
+static UINT32 *plain = NULL, plainCnt = 0;
+static UINT32 generation = 0;
+static INT32 *moves = NULL;
+static INT32 *fail = NULL, *output = NULL, *outLink = NULL;
+static UINT32 stateCnt = 0, stateAlloc = 0;
+static char *listText = NULL;
+static LISTED *listed = NULL, *listDirs = NULL;
+static UINT32 dirCnt = 0, listMask = 0, dirMask = 0;
+static INT32 *listTable = NULL, *dirTable = NULL;
+
+
+static char *regexLiteral(char*);
+static char *globLiteral(char*);
+static char *regexPrefix(char*);
+static char *globPrefix(char*);
+static char *skipBracket(char*);
+static INT32 addLiteral(char*, UINT32);
+static INT32 newState(void);
+static LISTED *findListed(LISTED*, INT32*, UINT32, char*, size_t);
+static void addListed(LISTED*, INT32*, UINT32, UINT32);
+static UINT32 hashText(char*, size_t);
+static UINT32 tableSize(UINT32);
+
+
+/* addPattern() compiles a pattern, either a POSIX basic regex or a shell     */
+/* glob, and notes the longest text that any path it matches must contain.    */
+/* Matching is not case sensitive.                                            */
+
+INT32 addPattern(char *text, UINT8 glob)
+{
+	PATTERN *ptr;
+
+	if (matchCnt == 65535)
+	{
+		fprintf(stderr, "Maximum number of patterns exceeded!\n");
+		return(-1);
+	}
+
+	if (matchCnt == patternAlloc)
+	{
+		ptr = (PATTERN*) realloc(patterns,
+		                         sizeof(PATTERN) * (patternAlloc + 16));
+		if (ptr == NULL)
+		{
+			fprintf(stderr, "Memory error while adding pattern!\n");
+			return(-1);
+		}
+
+		patterns = ptr;
+		patternAlloc += 16;
+	}
+
+	ptr = &patterns[matchCnt];
+	memset(ptr, 0, sizeof(PATTERN));
+
+	ptr->text = strdup(text);
+	if (ptr->text == NULL)
+	{
+		fprintf(stderr, "Memory error while adding pattern!\n");
+		return(-1);
+	}
+
+	ptr->glob = glob;
+	ptr->same = -1;
+
+	if (glob == 0)
+	{
+		if (regcomp(&ptr->regex, text, REG_ICASE | REG_NOSUB | REG_NEWLINE)
+		    != 0)
+		{
+			fprintf(stderr, "Invalid pattern - \"%s\"!\n", text);
+			free(ptr->text);
+			return(-1);
+		}
+
+		ptr->literal = regexLiteral(text);
+		ptr->prefix = regexPrefix(text);
+	}
+	else
+	{
+		ptr->literal = globLiteral(text);
+		ptr->prefix = globPrefix(text);
+	}
+
+	if (debug > 0)
+		printf("pattern \"%s\" needs \"%s\" at \"%s\"\n", text,
+		       (ptr->literal == NULL) ? "" : ptr->literal,
+		       (ptr->prefix == NULL) ? "" : ptr->prefix);
+
+	matchCnt += 1;
+	selecting = 1;
+
+	return(0);
+}
+
+
+/* compilePatterns() builds one Aho-Corasick automaton from the literal text  */
+/* of every pattern, so that a single pass over a path finds which patterns   */
+/* could match it. Only those, and those without literal text (kept in a     */
+/* list of their own), are then tried. It is called once, after all of the    */
+/* patterns have been added.                                                  */
+
+INT32 compilePatterns(void)
+{
+	UINT32 i, head, tail, *queue;
+	INT32 state, target;
+	int c;
+
+	if (matchCnt == 0)
+		return(0);
+
+	candidates = (UINT32*) malloc(sizeof(UINT32) * matchCnt);
+	plain = (UINT32*) malloc(sizeof(UINT32) * matchCnt);
+	if ((candidates == NULL) || (plain == NULL) || (newState() != 0))
+	{
+		fprintf(stderr, "Memory error while compiling patterns!\n");
+		return(-1);
+	}
+
+	plainCnt = 0;
+
+	for (i = 0; i < matchCnt; i += 1)
+	{
+		if (patterns[i].literal == NULL)
+		{
+			plain[plainCnt++] = i;
+		}
+		else if (addLiteral(patterns[i].literal, i) != 0)
+		{
+			fprintf(stderr, "Memory error while compiling patterns!\n");
+			return(-1);
+		}
+	}
+
+	queue = (UINT32*) malloc(sizeof(UINT32) * stateCnt);
+	if (queue == NULL)
+	{
+		fprintf(stderr, "Memory error while compiling patterns!\n");
+		return(-1);
+	}
+
+	head = 0;
+	tail = 0;
+
+	for (c = 0; c < 256; c += 1)
+	{
+		target = moves[c];
+
+		if (target == -1)
+		{
+			moves[c] = 0;
+		}
+		else
+		{
+			fail[target] = 0;
+			outLink[target] = -1;
+			queue[tail++] = target;
+		}
+	}
+
+	while (head < tail)
+	{
+		state = queue[head++];
+
+		for (c = 0; c < 256; c += 1)
+		{
+			target = moves[state * 256 + c];
+
+			if (target == -1)
+			{
+				moves[state * 256 + c] = moves[fail[state] * 256 + c];
+			}
+			else
+			{
+				fail[target] = moves[fail[state] * 256 + c];
+				outLink[target] = (output[fail[target]] != -1) ?
+				                  fail[target] : outLink[fail[target]];
+				queue[tail++] = target;
+			}
+		}
+	}
+
+	free(queue);
+
+	if (debug > 0) printf("%lu pattern states\n", stateCnt);
+
+	return(0);
+}
+
+
+/* matchPath() returns 1 if path was listed or matches any pattern, and 0 if  */
+/* not. Listed paths are looked up in a hash set, in time proportional to the */
+/* length of the path.                                                        */
+
+INT32 matchPath(char *path)
+{
+	UINT32 i, count;
+	INT32 state, found, p;
+	UINT8 *ptr;
+	char *name;
+	LISTED *entry;
+
+	name = path;
+	while (*name == '/')
+		name += 1;
+
+	if (listCnt > 0)
+	{
+		entry = findListed(listed, listTable, listMask, name, strlen(name));
+		if (entry != NULL)
+		{
+			entry->found = 1;
+			return(1);
+		}
+	}
+
+	if (matchCnt == 0)
+		return(0);
+
+	generation += 1;
+	count = 0;
+	state = 0;
+
+	for (ptr = (UINT8*) path; *ptr != '\0'; ptr += 1)
+	{
+		state = moves[state * 256 + tolower(*ptr)];
+
+		found = (output[state] != -1) ? state : outLink[state];
+
+		while (found != -1)
+		{
+			for (p = output[found]; p != -1; p = patterns[p].same)
+			{
+				if (patterns[p].seen != generation)
+				{
+					patterns[p].seen = generation;
+					candidates[count++] = p;
+				}
+			}
+
+			found = outLink[found];
+		}
+	}
+
+	for (i = 0; i < plainCnt; i += 1)
+		candidates[count++] = plain[i];
+
+	for (i = 0; i < count; i += 1)
+	{
+		p = candidates[i];
+
+		if (patterns[p].glob == 0)
+		{
+			if (regexec(&patterns[p].regex, path, 0, NULL, 0) == 0)
+				return(1);
+		}
+		else
+		{
+			if (fnmatch(patterns[p].text, name, FNM_CASEFOLD) == 0)
+				return(1);
+		}
+	}
+
+	return(0);
+}
+
+
+/* matchDir() returns 1 if a path under directory path could be listed or    */
+/* match any pattern, and 0 if no listed path is under it and every pattern  */
+/* must start with text the directory rules out, so that its files can be    */
+/* skipped without being looked at.                                          */
+
+INT32 matchDir(char *path)
+{
+	UINT32 i;
+	size_t length;
+	char *name;
+
+	name = path;
+	while (*name == '/')
+		name += 1;
+
+	if ((listCnt > 0) && ((*name == '\0') ||
+	    (findListed(listDirs, dirTable, dirMask, name, strlen(name)) != NULL)))
+		return(1);
+
+	for (i = 0; i < matchCnt; i += 1)
+	{
+		if (patterns[i].prefix == NULL)
+			return(1);
+
+		if (patterns[i].glob == 0)
+		{
+			length = min(strlen(path), strlen(patterns[i].prefix));
+			if (strncasecmp(path, patterns[i].prefix, length) == 0)
+				return(1);
+		}
+		else
+		{
+			length = min(strlen(name), strlen(patterns[i].prefix));
+			if (strncasecmp(name, patterns[i].prefix, length) == 0)
+				return(1);
+		}
+	}
+
+	return(0);
+}
+
+
+/* loadPaths() reads a file listing paths to read, one per line, into a hash */
+/* set. Each directory above a listed path goes into a second set, so that    */
+/* directories holding none of them can be skipped.                           */
+
+INT32 loadPaths(char *name)
+{
+	struct stat sbuf;
+	char *ptr, *end, *line;
+	ssize_t got;
+	size_t total, slashes;
+	UINT32 lines;
+	int fd;
+
+	if (listText != NULL)
+	{
+		fprintf(stderr, "Only one path list (-T) may be given!\n");
+		return(-1);
+	}
+
+	fd = open(name, O_RDONLY);
+	if ((fd == -1) || (fstat(fd, &sbuf) != 0))
+	{
+		fprintf(stderr, "Error %d opening path list %s!\n", errno, name);
+		if (fd != -1) close(fd);
+		return(-1);
+	}
+
+	listText = (char*) malloc(sbuf.st_size + 1);
+	if (listText == NULL)
+	{
+		fprintf(stderr, "Memory error while reading path list!\n");
+		close(fd);
+		return(-1);
+	}
+
+	total = 0;
+	while (total < (size_t) sbuf.st_size)
+	{
+		got = read(fd, &listText[total], sbuf.st_size - total);
+		if (got <= 0)
+		{
+			fprintf(stderr, "Error %d reading path list %s!\n", errno, name);
+			close(fd);
+			return(-1);
+		}
+
+		total += got;
+	}
+
+	close(fd);
+	listText[total] = '\0';
+
+	lines = 1;
+	slashes = 0;
+	for (ptr = listText; *ptr != '\0'; ptr += 1)
+	{
+		if (*ptr == '\n')
+			lines += 1;
+		else if (*ptr == '/')
+			slashes += 1;
+	}
+
+	listMask = tableSize(lines) - 1;
+	dirMask = tableSize((UINT32) slashes) - 1;
+
+	listed = (LISTED*) malloc(sizeof(LISTED) * lines);
+	listDirs = (LISTED*) malloc(sizeof(LISTED) * max(slashes, 1));
+	listTable = (INT32*) malloc(sizeof(INT32) * (listMask + 1));
+	dirTable = (INT32*) malloc(sizeof(INT32) * (dirMask + 1));
+	if ((listed == NULL) || (listDirs == NULL) || (listTable == NULL) ||
+	    (dirTable == NULL))
+	{
+		fprintf(stderr, "Memory error while reading path list!\n");
+		return(-1);
+	}
+
+	memset(listTable, 0xFF, sizeof(INT32) * (listMask + 1));
+	memset(dirTable, 0xFF, sizeof(INT32) * (dirMask + 1));
+
+	line = listText;
+	while (line != NULL)
+	{
+		end = strchr(line, '\n');
+		if (end != NULL)
+			*end = '\0';
+
+		if ((*line != '\0') && (line[strlen(line) - 1] == '\r'))
+			line[strlen(line) - 1] = '\0';
+
+		while (*line == '/')
+			line += 1;
+
+		if ((*line != '\0') &&
+		    (findListed(listed, listTable, listMask, line, strlen(line))
+		     == NULL))
+		{
+			listed[listCnt].path = line;
+			listed[listCnt].length = strlen(line);
+			listed[listCnt].found = 0;
+			addListed(listed, listTable, listMask, listCnt);
+			listCnt += 1;
+
+			for (ptr = strchr(line, '/'); ptr != NULL;
+			     ptr = strchr(ptr + 1, '/'))
+			{
+				if (findListed(listDirs, dirTable, dirMask, line,
+				               ptr - line + 1) == NULL)
+				{
+					listDirs[dirCnt].path = line;
+					listDirs[dirCnt].length = ptr - line + 1;
+					addListed(listDirs, dirTable, dirMask, dirCnt);
+					dirCnt += 1;
+				}
+			}
+		}
+
+		line = (end != NULL) ? end + 1 : NULL;
+	}
+
+	if (debug > 0)
+		printf("%lu paths in %lu directories listed\n", listCnt, dirCnt);
+
+	selecting = 1;
+
+	return(0);
+}
+
+
+/* reportMissing() lists the paths from the path list that were never read,  */
+/* and returns how many there were.                                           */
+
+UINT32 reportMissing(void)
+{
+	UINT32 i, missing;
+
+	missing = 0;
+
+	for (i = 0; i < listCnt; i += 1)
+	{
+		if (listed[i].found == 0)
+		{
+			fprintf(stderr, "%s was not found!\n", listed[i].path);
+			missing += 1;
+		}
+	}
+
+	if (missing > 0)
+		fprintf(stderr, "%lu of %lu listed paths were not found!\n", missing,
+		        listCnt);
+
+	return(missing);
+}
+
+
+/* freePatterns() frees the compiled patterns, the automaton and the path     */
+/* list.                                                                      */
+
+void freePatterns(void)
+{
+	UINT32 i;
+
+	for (i = 0; i < matchCnt; i += 1)
+	{
+		if (patterns[i].glob == 0)
+			regfree(&patterns[i].regex);
+
+		free(patterns[i].text);
+		free(patterns[i].literal);
+		free(patterns[i].prefix);
+	}
+
+	free(patterns);
+	free(candidates);
+	free(plain);
+	free(moves);
+	free(fail);
+	free(output);
+	free(outLink);
+
+	patterns = NULL;
+	candidates = NULL;
+	plain = NULL;
+	plainCnt = 0;
+	moves = NULL;
+	fail = NULL;
+	output = NULL;
+	outLink = NULL;
+	free(listText);
+	free(listed);
+	free(listDirs);
+	free(listTable);
+	free(dirTable);
+
+	listText = NULL;
+	listed = NULL;
+	listDirs = NULL;
+	listTable = NULL;
+	dirTable = NULL;
+	patternAlloc = 0;
+	stateCnt = 0;
+	stateAlloc = 0;
+	matchCnt = 0;
+	listCnt = 0;
+	dirCnt = 0;
+	selecting = 0;
+
+	return;
+}
+
+
+/* regexLiteral() returns the longest run of plain characters that must       */
+/* appear in anything a basic regex matches, or NULL if there is none.        */
+/* Characters made optional by * or \{\}, and anything inside a group, are    */
+/* left out, and alternation means no text is certain.                        */
+
+static char *regexLiteral(char *text)
+{
+	char *run, *best, *ptr;
+	size_t runLen, bestLen;
+	int depth, c;
+
+	run = (char*) malloc(strlen(text) + 1);
+	best = (char*) malloc(strlen(text) + 1);
+	if ((run == NULL) || (best == NULL))
+		goto none;
+
+	runLen = 0;
+	bestLen = 0;
+	depth = 0;
+	ptr = text;
+
+	if (*ptr == '^')
+		ptr += 1;
+
+	if (*ptr == '*')
+		ptr += 1;
+
+	while (*ptr != '\0')
+	{
+		c = -1;
+
+		if (*ptr == '\\')
+		{
+			ptr += 1;
+
+			if ((*ptr == '|') || (*ptr == '\0'))
+				goto none;
+
+			if ((*ptr == '(') || (*ptr == ')'))
+			{
+				depth += (*ptr == '(') ? 1 : -1;
+				ptr += 1;
+
+				if (*ptr == '*')
+					ptr += 1;
+			}
+			else if (*ptr == '{')
+			{
+				ptr = strstr(ptr, "\\}");
+				if (ptr == NULL)
+					goto none;
+
+				ptr += 2;
+			}
+			else if (isalnum((UINT8) *ptr) || (*ptr == '<') || (*ptr == '>') ||
+			         (*ptr == '`') || (*ptr == '\'') || (*ptr == '?') ||
+			         (*ptr == '+'))
+			{
+				ptr += 1;
+			}
+			else
+			{
+				c = (UINT8) *ptr;
+				ptr += 1;
+			}
+		}
+		else if (*ptr == '*')
+		{
+			ptr += 1;
+		}
+		else if (*ptr == '.')
+		{
+			ptr += 1;
+		}
+		else if (*ptr == '[')
+		{
+			ptr = skipBracket(ptr);
+			if (ptr == NULL)
+				goto none;
+		}
+		else if ((*ptr == '$') && (*(ptr + 1) == '\0'))
+		{
+			ptr += 1;
+		}
+		else
+		{
+			c = (UINT8) *ptr;
+			ptr += 1;
+		}
+
+		if ((c != -1) && (depth == 0) && (*ptr != '*') &&
+		    (strncmp(ptr, "\\{", 2) != 0) &&
+		    (strncmp(ptr, "\\?", 2) != 0))
+		{
+			run[runLen++] = tolower(c);
+		}
+		else
+		{
+			if (runLen > bestLen)
+			{
+				memcpy(best, run, runLen);
+				bestLen = runLen;
+			}
+
+			runLen = 0;
+		}
+	}
+
+	if (runLen > bestLen)
+	{
+		memcpy(best, run, runLen);
+		bestLen = runLen;
+	}
+
+	free(run);
+
+	if (bestLen == 0)
+	{
+		free(best);
+		return(NULL);
+	}
+
+	best[bestLen] = '\0';
+
+	return(best);
+
+none:
+	free(run);
+	free(best);
+
+	return(NULL);
+}
+
+
+/* globLiteral() returns the longest run of plain characters in a shell glob, */
+/* or NULL if there is none.                                                  */
+
+static char *globLiteral(char *text)
+{
+	char *run, *best, *ptr;
+	size_t runLen, bestLen;
+	int c;
+
+	run = (char*) malloc(strlen(text) + 1);
+	best = (char*) malloc(strlen(text) + 1);
+	if ((run == NULL) || (best == NULL))
+		goto none;
+
+	runLen = 0;
+	bestLen = 0;
+	ptr = text;
+
+	while (*ptr != '\0')
+	{
+		c = -1;
+
+		if ((*ptr == '*') || (*ptr == '?'))
+		{
+			ptr += 1;
+		}
+		else if (*ptr == '[')
+		{
+			ptr = skipBracket(ptr);
+			if (ptr == NULL)
+				goto none;
+		}
+		else if ((*ptr == '\\') && (*(ptr + 1) != '\0'))
+		{
+			c = (UINT8) *(ptr + 1);
+			ptr += 2;
+		}
+		else
+		{
+			c = (UINT8) *ptr;
+			ptr += 1;
+		}
+
+		if (c != -1)
+		{
+			run[runLen++] = tolower(c);
+		}
+		else
+		{
+			if (runLen > bestLen)
+			{
+				memcpy(best, run, runLen);
+				bestLen = runLen;
+			}
+
+			runLen = 0;
+		}
+	}
+
+	if (runLen > bestLen)
+	{
+		memcpy(best, run, runLen);
+		bestLen = runLen;
+	}
+
+	free(run);
+
+	if (bestLen == 0)
+	{
+		free(best);
+		return(NULL);
+	}
+
+	best[bestLen] = '\0';
+
+	return(best);
+
+none:
+	free(run);
+	free(best);
+
+	return(NULL);
+}
+
+
+/* regexPrefix() returns the text that anything a basic regex matches must   */
+/* start with, which it has only if it is anchored with ^, or NULL.           */
+
+static char *regexPrefix(char *text)
+{
+	char *prefix, *ptr;
+	size_t length;
+	int c;
+
+	if ((*text != '^') || (strstr(text, "\\|") != NULL))
+		return(NULL);
+
+	prefix = (char*) malloc(strlen(text) + 1);
+	if (prefix == NULL)
+		return(NULL);
+
+	length = 0;
+	ptr = text + 1;
+
+	while (*ptr != '\0')
+	{
+		if ((*ptr == '\\') && (*(ptr + 1) != '\0') &&
+		    (strchr("(){}|?+<>`'", *(ptr + 1)) == NULL) &&
+		    (isalnum((UINT8) *(ptr + 1)) == 0))
+		{
+			c = (UINT8) *(ptr + 1);
+			ptr += 2;
+		}
+		else if (strchr(".[*\\$^", *ptr) == NULL)
+		{
+			c = (UINT8) *ptr;
+			ptr += 1;
+		}
+		else
+		{
+			break;
+		}
+
+		if ((*ptr == '*') || (strncmp(ptr, "\\{", 2) == 0) ||
+		    (strncmp(ptr, "\\?", 2) == 0))
+			break;
+
+		prefix[length++] = tolower(c);
+	}
+
+	if (length == 0)
+	{
+		free(prefix);
+		return(NULL);
+	}
+
+	prefix[length] = '\0';
+
+	return(prefix);
+}
+
+
+/* globPrefix() returns the text before the first wildcard of a shell glob,   */
+/* or NULL if it starts with one.                                             */
+
+static char *globPrefix(char *text)
+{
+	char *prefix, *ptr;
+	size_t length;
+
+	prefix = (char*) malloc(strlen(text) + 1);
+	if (prefix == NULL)
+		return(NULL);
+
+	length = 0;
+	ptr = text;
+
+	while ((*ptr != '\0') && (strchr("*?[", *ptr) == NULL))
+	{
+		if ((*ptr == '\\') && (*(ptr + 1) != '\0'))
+			ptr += 1;
+
+		prefix[length++] = tolower((UINT8) *ptr);
+		ptr += 1;
+	}
+
+	if (length == 0)
+	{
+		free(prefix);
+		return(NULL);
+	}
+
+	prefix[length] = '\0';
+
+	return(prefix);
+}
+
+
+/* skipBracket() returns the character following a bracket expression, or     */
+/* NULL if it is not closed.                                                  */
+
+static char *skipBracket(char *ptr)
+{
+	char *end;
+
+	ptr += 1;
+
+	if ((*ptr == '^') || (*ptr == '!'))
+		ptr += 1;
+
+	if (*ptr == ']')
+		ptr += 1;
+
+	while (*ptr != ']')
+	{
+		if (*ptr == '\0')
+			return(NULL);
+
+		if ((*ptr == '[') &&
+		    ((*(ptr + 1) == ':') || (*(ptr + 1) == '.') || (*(ptr + 1) == '=')))
+		{
+			end = strchr(ptr + 2, *(ptr + 1));
+			while ((end != NULL) && (*(end + 1) != ']'))
+				end = strchr(end + 1, *(ptr + 1));
+
+			if (end == NULL)
+				return(NULL);
+
+			ptr = end + 2;
+		}
+		else
+		{
+			ptr += 1;
+		}
+	}
+
+	return(ptr + 1);
+}
+
+
+/* addLiteral() adds the literal text of a pattern to the automaton.          */
+
+static INT32 addLiteral(char *literal, UINT32 pattern)
+{
+	INT32 state, target;
+	UINT8 *ptr;
+
+	state = 0;
+
+	for (ptr = (UINT8*) literal; *ptr != '\0'; ptr += 1)
+	{
+		target = moves[state * 256 + *ptr];
+
+		if (target == -1)
+		{
+			target = newState();
+			if (target == -1)
+				return(-1);
+
+			moves[state * 256 + *ptr] = target;
+		}
+
+		state = target;
+	}
+
+	patterns[pattern].same = output[state];
+	output[state] = pattern;
+
+	return(0);
+}
+
+
+/* newState() adds a state to the automaton, with no moves yet.               */
+
+static INT32 newState(void)
+{
+	UINT32 size;
+	INT32 *ptr;
+	int c;
+
+	if (stateCnt == stateAlloc)
+	{
+		size = (stateAlloc == 0) ? 64 : stateAlloc * 2;
+
+		ptr = (INT32*) realloc(moves, sizeof(INT32) * 256 * size);
+		if (ptr == NULL)
+			return(-1);
+		moves = ptr;
+
+		ptr = (INT32*) realloc(fail, sizeof(INT32) * size);
+		if (ptr == NULL)
+			return(-1);
+		fail = ptr;
+
+		ptr = (INT32*) realloc(output, sizeof(INT32) * size);
+		if (ptr == NULL)
+			return(-1);
+		output = ptr;
+
+		ptr = (INT32*) realloc(outLink, sizeof(INT32) * size);
+		if (ptr == NULL)
+			return(-1);
+		outLink = ptr;
+
+		stateAlloc = size;
+	}
+
+	for (c = 0; c < 256; c += 1)
+		moves[stateCnt * 256 + c] = -1;
+
+	fail[stateCnt] = 0;
+	output[stateCnt] = -1;
+	outLink[stateCnt] = -1;
+
+	stateCnt += 1;
+
+	return(stateCnt - 1);
+}
+
+
+/* findListed() looks up the first length characters of path in a hash set  */
+/* of listed paths or directories, ignoring case.                            */
+
+static LISTED *findListed(LISTED *entries, INT32 *table, UINT32 mask,
+                          char *path, size_t length)
+{
+	UINT32 i;
+	LISTED *entry;
+
+	i = hashText(path, length) & mask;
+
+	while (table[i] != -1)
+	{
+		entry = &entries[table[i]];
+
+		if ((entry->length == length) &&
+		    (strncasecmp(entry->path, path, length) == 0))
+			return(entry);
+
+		i = (i + 1) & mask;
+	}
+
+	return(NULL);
+}
+
+
+static void addListed(LISTED *entries, INT32 *table, UINT32 mask,
+                      UINT32 index)
+{
+	UINT32 i;
+
+	i = hashText(entries[index].path, entries[index].length) & mask;
+
+	while (table[i] != -1)
+		i = (i + 1) & mask;
+
+	table[i] = index;
+
+	return;
+}
+
+
+/* hashText() returns the FNV-1a hash of text folded to lower case.          */
+
+static UINT32 hashText(char *text, size_t length)
+{
+	UINT32 hash;
+	size_t i;
+
+	hash = 2166136261UL;
+
+	for (i = 0; i < length; i += 1)
+	{
+		hash ^= (UINT32) tolower((UINT8) text[i]);
+		hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+	}
+
+	return(hash);
+}
+
+
+/* tableSize() returns a power of two at least twice count, so that a hash   */
+/* table of that size stays at most half full.                               */
+
+static UINT32 tableSize(UINT32 count)
+{
+	UINT32 size;
+
+	size = 16;
+	while (size < count * 2)
+		size *= 2;
+
+	return(size);
+}
@@ -0,0 +1,599 @@
+/*
+
+mtf - a Microsoft Tape Format reader (and future writer?)
+Copyright (C) 1999  D. Alan Stewart, Layton Graphics, Inc.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+Contact the author at:
+
+D. Alan Stewart
+Layton Graphics, Inc.
+155 Woolco Dr.
+Marietta, GA 30062, USA
+astewart@layton-graphics.com
+
+See mtf.c for version history, contributors, etc.
+
+**
+**	mtfpool.c
+**
+**	a pool of worker threads that create and write extracted files, so that
+**	the per-file cost of open, fchown, close and utime is paid in parallel
+**
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <utime.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include "mtf.h"
+
+
+extern UINT8 verbose, debug, asyncIO;
+extern UINT16 workers;
+extern uid_t owner;
+extern gid_t group;
+
+
+typedef struct JOB_BUFFER
+{
+	struct JOB_BUFFER	*next;						/* chain */
+	size_t				length;						/* bytes used */
+	UINT8				data[JOB_BUFFER_SIZE];		/* file contents */
+} JOB_BUFFER;
+
+
+typedef struct FILE_JOB
+{
+	char			*path;		/* full path of file, for messages */
+	int				dir;		/* directory it is created in */
+	char			*name;		/* name relative to dir */
+	struct utimbuf	times;		/* access and modification times */
+	JOB_BUFFER		*first;		/* file contents */
+	JOB_BUFFER		*last;		/* buffer being filled */
+	size_t			length;		/* bytes of data */
+	int				fd;			/* file written directly, once too large */
+	struct FILE_JOB	*next;		/* queue */
+} FILE_JOB;
+
+
+static pthread_t *pool = NULL;
+static UINT16 poolSize = 0;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobQueued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobTaken = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobDone = PTHREAD_COND_INITIALIZER;
+static FILE_JOB *queueHead = NULL, *queueTail = NULL;
+static UINT32 queueCount, poolBusy, poolErrors;
+static size_t queueBytes;
+static UINT8 poolStop;
+static FILE_JOB *job = NULL;
+static JOB_BUFFER *spareBuffers = NULL;
+
+
+static void *workerMain(void*);
+static INT32 writeJob(FILE_JOB*);
+static INT32 spillJob(FILE_JOB*);
+static JOB_BUFFER *getBuffer(void);
+static void freeBuffers(JOB_BUFFER*);
+static void freeJob(FILE_JOB*);
+
+
+/* startWorkers() starts the worker threads. Nothing is started if no workers */
+/* were asked for.                                                            */
+
+INT32 startWorkers(void)
+{
+	UINT16 i;
+
+	if ((workers == 0) || (poolSize != 0))
+		return(0);
+
+	pool = (pthread_t*) malloc(sizeof(pthread_t) * workers);
+	if (pool == NULL)
+	{
+		fprintf(stderr, "Unable to allocate worker threads!\n");
+		return(-1);
+	}
+
+	poolStop = 0;
+	poolErrors = 0;
+	poolBusy = 0;
+	queueCount = 0;
+	queueBytes = 0;
+
+	for (i = 0; i < workers; i += 1)
+	{
+		if (pthread_create(&pool[i], NULL, workerMain, NULL) != 0)
+		{
+			fprintf(stderr, "Unable to start worker thread!\n");
+			poolSize = i;
+			stopWorkers();
+			return(-1);
+		}
+	}
+
+	poolSize = workers;
+
+	return(0);
+}
+
+
+/* stopWorkers() lets the workers finish the queue and waits for them. It     */
+/* returns -1 if any file could not be written.                               */
+
+INT32 stopWorkers(void)
+{
+	UINT16 i;
+	JOB_BUFFER *next;
+
+	if (job != NULL)
+	{
+		if (job->fd != -1)
+			close(job->fd);
+
+		freeJob(job);
+		job = NULL;
+	}
+
+	if (pool == NULL)
+		return(0);
+
+	pthread_mutex_lock(&poolLock);
+	poolStop = 1;
+	pthread_cond_broadcast(&jobQueued);
+	pthread_mutex_unlock(&poolLock);
+
+	for (i = 0; i < poolSize; i += 1)
+		pthread_join(pool[i], NULL);
+
+	free(pool);
+	pool = NULL;
+	poolSize = 0;
+
+	while (spareBuffers != NULL)
+	{
+		next = spareBuffers->next;
+		free(spareBuffers);
+		spareBuffers = next;
+	}
+
+	return((poolErrors == 0) ? 0 : -1);
+}
+
+
+/* drainWorkers() waits until every queued file has been written. It returns  */
+/* -1 if any file could not be written.                                       */
+
+INT32 drainWorkers(void)
+{
+	UINT32 errors;
+
+	if (pool == NULL)
+		return(0);
+
+	pthread_mutex_lock(&poolLock);
+
+	while ((queueCount > 0) || (poolBusy > 0))
+		pthread_cond_wait(&jobDone, &poolLock);
+
+	errors = poolErrors;
+	pthread_mutex_unlock(&poolLock);
+
+	return((errors == 0) ? 0 : -1);
+}
+
+
+/* beginJob() starts collecting the contents of a file for the workers. The  */
+/* file is created as name in the directory open on dir, on which the job     */
+/* takes its own hold. Data given to putData() for DEFERRED_FILE is added to  */
+/* it by jobWrite().                                                          */
+
+INT32 beginJob(int dir, char *name, char *path)
+{
+	UINT32 errors;
+
+	pthread_mutex_lock(&poolLock);
+	errors = poolErrors;
+	pthread_mutex_unlock(&poolLock);
+
+	if (errors != 0)
+		return(-1);
+
+	job = (FILE_JOB*) calloc(1, sizeof(FILE_JOB));
+	if (job == NULL)
+	{
+		fprintf(stderr, "Memory error while queueing %s!\n", path);
+		return(-1);
+	}
+
+	job->path = strdup(path);
+	job->name = strdup(name);
+	job->fd = -1;
+	job->dir = holdDir(dir);
+
+	if ((job->path == NULL) || (job->name == NULL) || (job->dir == -1))
+	{
+		fprintf(stderr, "Memory error while queueing %s!\n", path);
+		freeJob(job);
+		job = NULL;
+		return(-1);
+	}
+
+	return(0);
+}
+
+
+/* jobWrite() adds data to the file being collected, in buffers taken from a */
+/* pool that workers return them to. A file that grows past POOL_FILE_LIMIT   */
+/* is not worth holding in memory; it is created right away and the rest of   */
+/* it is written as it is read, as without workers.                           */
+
+INT32 jobWrite(UINT8 *data, size_t length)
+{
+	JOB_BUFFER *buffer;
+	size_t bytes;
+
+	if (job->fd != -1)
+		return(putData(job->fd, data, length));
+
+	if (job->length + length > POOL_FILE_LIMIT)
+	{
+		if (spillJob(job) != 0)
+			return(-1);
+
+		return(putData(job->fd, data, length));
+	}
+
+	while (length > 0)
+	{
+		if ((job->last == NULL) || (job->last->length == JOB_BUFFER_SIZE))
+		{
+			buffer = getBuffer();
+			if (buffer == NULL)
+			{
+				fprintf(stderr, "Memory error while queueing %s!\n", job->path);
+				return(-1);
+			}
+
+			if (job->last == NULL)
+				job->first = buffer;
+			else
+				job->last->next = buffer;
+			job->last = buffer;
+		}
+
+		buffer = job->last;
+
+		bytes = min(length, JOB_BUFFER_SIZE - buffer->length);
+		memcpy(&buffer->data[buffer->length], data, bytes);
+		buffer->length += bytes;
+		job->length += bytes;
+		data += bytes;
+		length -= bytes;
+	}
+
+	return(0);
+}
+
+
+/* jobFile() creates the file being collected right away and returns its     */
+/* descriptor, so that its data can be written to it directly.                */
+
+INT32 jobFile(void)
+{
+	if ((job->fd == -1) && (spillJob(job) != 0))
+		return(-1);
+
+	return(job->fd);
+}
+
+
+/* finishJob() hands the collected file to the workers, waiting for room in   */
+/* the queue if it is full. A file that was written directly is closed here.  */
+
+INT32 finishJob(struct utimbuf *times)
+{
+	FILE_JOB *done;
+	INT32 result;
+	UINT32 errors;
+
+	done = job;
+	job = NULL;
+
+	done->times = *times;
+
+	if (done->fd != -1)
+	{
+		if (asyncIO != 0)
+		{
+			result = asyncClose(done->fd, done->path, times);
+		}
+		else
+		{
+			result = close(done->fd);
+			if (result != 0)
+				fprintf(stderr, "Error %d closing %s!\n", errno, done->path);
+			else if (setTimes(done->dir, done->name, times) != 0)
+				fprintf(stderr,
+				        "Error %d setting modification/access time of %s!\n",
+				        errno, done->path);
+		}
+
+		freeJob(done);
+
+		return((result == 0) ? 0 : -1);
+	}
+
+	pthread_mutex_lock(&poolLock);
+
+	while ((queueCount >= POOL_QUEUE) ||
+	       ((queueCount > 0) && (queueBytes + done->length > POOL_QUEUE_BYTES)))
+		pthread_cond_wait(&jobTaken, &poolLock);
+
+	done->next = NULL;
+	if (queueTail == NULL)
+		queueHead = done;
+	else
+		queueTail->next = done;
+	queueTail = done;
+	queueCount += 1;
+	queueBytes += done->length;
+
+	pthread_cond_signal(&jobQueued);
+	errors = poolErrors;
+	pthread_mutex_unlock(&poolLock);
+
+	return((errors == 0) ? 0 : -1);
+}
+
+
+/* workerMain() is the body of a worker thread. It writes queued files until  */
+/* told to stop and the queue is empty.                                       */
+
+static void *workerMain(void *arg)
+{
+	FILE_JOB *next;
+
+	pthread_mutex_lock(&poolLock);
+
+	for (;;)
+	{
+		while ((queueHead == NULL) && (poolStop == 0))
+			pthread_cond_wait(&jobQueued, &poolLock);
+
+		if (queueHead == NULL)
+			break;
+
+		next = queueHead;
+		queueHead = next->next;
+		if (queueHead == NULL)
+			queueTail = NULL;
+		queueCount -= 1;
+		queueBytes -= next->length;
+		poolBusy += 1;
+
+		pthread_cond_signal(&jobTaken);
+		pthread_mutex_unlock(&poolLock);
+
+		if (writeJob(next) != 0)
+		{
+			pthread_mutex_lock(&poolLock);
+			poolErrors += 1;
+			pthread_mutex_unlock(&poolLock);
+		}
+
+		freeJob(next);
+
+		pthread_mutex_lock(&poolLock);
+		poolBusy -= 1;
+		pthread_cond_broadcast(&jobDone);
+	}
+
+	pthread_mutex_unlock(&poolLock);
+
+	return(NULL);
+}
+
+
+/* writeJob() creates a file, writes its contents and sets its owner, group   */
+/* and times.                                                                 */
+
+static INT32 writeJob(FILE_JOB *next)
+{
+	int output, count, i;
+	ssize_t result;
+	JOB_BUFFER *buffer;
+	struct iovec iov[POOL_FILE_LIMIT / JOB_BUFFER_SIZE + 1];
+
+	output = openat(next->dir, next->name, O_WRONLY | O_TRUNC | O_CREAT,
+	                S_IRWXU | S_IRWXG | S_IRWXO);
+	if (output == -1)
+	{
+		fprintf(stderr, "Error %d opening/creating %s for writing!\n",
+		        errno, next->path);
+		return(-1);
+	}
+
+	if ((owner != -1) || (group != -1))
+	{
+		if (fchown(output, owner, group) != 0)
+		{
+			fprintf(stderr, "Error %d setting owner/group of %s!\n",
+			        errno, next->path);
+		}
+	}
+
+	count = 0;
+	for (buffer = next->first; buffer != NULL; buffer = buffer->next)
+	{
+		iov[count].iov_base = buffer->data;
+		iov[count].iov_len = buffer->length;
+		count += 1;
+	}
+
+	i = 0;
+	while (i < count)
+	{
+		result = writev(output, &iov[i], count - i);
+		if (result <= 0)
+		{
+			fprintf(stderr, "Error %d writing %s!\n", errno, next->path);
+			close(output);
+			return(-1);
+		}
+
+		while ((i < count) && ((size_t) result >= iov[i].iov_len))
+		{
+			result -= iov[i].iov_len;
+			i += 1;
+		}
+
+		if (i < count)
+		{
+			iov[i].iov_base = (UINT8*) iov[i].iov_base + result;
+			iov[i].iov_len -= result;
+		}
+	}
+
+	if (close(output) != 0)
+	{
+		fprintf(stderr, "Error %d closing %s!\n", errno, next->path);
+		return(-1);
+	}
+
+	if (setTimes(next->dir, next->name, &next->times) != 0)
+	{
+		fprintf(stderr, "Error %d setting modification/access time of %s!\n",
+		        errno, next->path);
+	}
+
+	return(0);
+}
+
+
+/* spillJob() creates a file that has grown too large to collect and writes  */
+/* what has been collected so far.                                            */
+
+static INT32 spillJob(FILE_JOB *big)
+{
+	JOB_BUFFER *buffer;
+
+	if (debug > 0) printf("writing %s directly\n", big->path);
+
+	big->fd = openat(big->dir, big->name, O_WRONLY | O_TRUNC | O_CREAT,
+	                 S_IRWXU | S_IRWXG | S_IRWXO);
+	if (big->fd == -1)
+	{
+		fprintf(stderr, "Error %d opening/creating %s for writing!\n",
+		        errno, big->path);
+		return(-1);
+	}
+
+	if ((owner != -1) || (group != -1))
+	{
+		if (fchown(big->fd, owner, group) != 0)
+		{
+			fprintf(stderr, "Error %d setting owner/group of %s!\n",
+			        errno, big->path);
+		}
+	}
+
+	for (buffer = big->first; buffer != NULL; buffer = buffer->next)
+	{
+		if (putData(big->fd, buffer->data, buffer->length) != 0)
+		{
+			fprintf(stderr, "Error writing %s!\n", big->path);
+			return(-1);
+		}
+	}
+
+	freeBuffers(big->first);
+	big->first = NULL;
+	big->last = NULL;
+	big->length = 0;
+
+	return(0);
+}
+
+
+/* getBuffer() takes a buffer from the pool, or allocates one if it is empty. */
+
+static JOB_BUFFER *getBuffer(void)
+{
+	JOB_BUFFER *buffer;
+
+	pthread_mutex_lock(&poolLock);
+
+	buffer = spareBuffers;
+	if (buffer != NULL)
+		spareBuffers = buffer->next;
+
+	pthread_mutex_unlock(&poolLock);
+
+	if (buffer == NULL)
+		buffer = (JOB_BUFFER*) malloc(sizeof(JOB_BUFFER));
+
+	if (buffer != NULL)
+	{
+		buffer->next = NULL;
+		buffer->length = 0;
+	}
+
+	return(buffer);
+}
+
+
+/* freeBuffers() returns a chain of buffers to the pool.                      */
+
+static void freeBuffers(JOB_BUFFER *chain)
+{
+	JOB_BUFFER *tail;
+
+	if (chain == NULL)
+		return;
+
+	for (tail = chain; tail->next != NULL; tail = tail->next);
+
+	pthread_mutex_lock(&poolLock);
+
+	tail->next = spareBuffers;
+	spareBuffers = chain;
+
+	pthread_mutex_unlock(&poolLock);
+
+	return;
+}
+
+
+static void freeJob(FILE_JOB *old)
+{
+	closeDir(old->dir);
+	freeBuffers(old->first);
+	free(old->path);
+	free(old->name);
+	free(old);
+
+	return;
+}
@@ -35,6 +35,8 @@ See mtf.c for version history, contributors, etc.
 */
 
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -42,6 +44,7 @@ See mtf.c for version history, contributors, etc.
 #include <limits.h>
 #include <sys/stat.h>
 #include <sys/fcntl.h>
+#include <fcntl.h>
 #include <sys/vfs.h>
 #include <utime.h>
 #include <unistd.h>
@@ -51,20 +54,23 @@ See mtf.c for version history, contributors, etc.
 #include <sys/ioctl.h>
 #include <sys/mtio.h>
 #include <ctype.h>
-#include <regex.h>
 #include <grp.h>
 #include <pwd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "mtf.h"
 
 
 extern char outPath[MAXPATHLEN + 1], curPath[MAXPATHLEN + 1];
 extern int mtfd, errno;
-extern UINT8 verbose, debug, list, forceCase;
-extern UINT8 tBuffer[MAX_TAPE_BLOCK_SIZE];
-extern UINT16 matchCnt;
-extern UINT16 tapeBlockSize;
-extern UINT32 minFree;
-extern regex_t match[MAX_PATTERN];
+extern UINT8 verbose, debug, list, forceCase, asyncIO, preallocate, verify;
+extern UINT8 tBuffer[TAPE_BUFFER_SIZE];
+extern UINT16 workers;
+extern size_t tapeBlockSize;
+extern UINT32 minFree, resumeFree, checkInterval;
+extern UINT8 readerRunning, tapeMapped, softMarks, archiving, selecting;
+extern UINT8 cataloging;
 extern uid_t owner;
 extern gid_t group;
 
@@ -72,9 +78,26 @@ extern gid_t group;
 UINT8 compressPossible;
 int filemark;
 UINT16 flbSize = 0;
-UINT16 remaining;
+UINT16 mbcType = MTF_NO_MBC;
+UINT32 remaining;
 UINT16 setCompress;
 UINT32 blockCnt;
+UINT8 *tData = tBuffer;
+UINT8 sparseFile;
+off_t dataEnd;
+int curDir = -1;
+static UINT8 *stage = NULL;
+static UINT32 staged = 0;
+static int stageFile = -1;
+static unsigned long long freeSpace = 0, sinceCheck = 0;
+static UINT8 freeKnown = 0;
+static UINT32 streamSum, sumPhase;
+static UINT8 summing = 0, summed = 0;
+static UINT8 pruneDir = 0;
+static UINT8 *kept = NULL;
+static UINT32 keptLen = 0, keptMax = 0;
+static UINT8 keeping = 0;
+static UINT8 fddPending = 0;
 struct mtop mt_cmd;
 
 MTF_DB_HDR *dbHdr;
@@ -90,6 +113,12 @@ MTF_EOTM_BLK *eotm;
 MTF_SFMB_BLK *sfmb;
 MTF_STREAM_HDR *stream;
 
+
+static INT32 keepData(UINT8*, UINT32);
+static INT32 checkSoftBlockSize(void);
+static INT32 haveSpace(UINT64*);
+
+
 /* openMedia() reads the MTF tape header and prepares for reading the first   */
 /* data set.                                                                  */
 
@@ -109,7 +138,13 @@ INT32 openMedia(void)
 		return(-1);
 	}
 
-	dbHdr = (MTF_DB_HDR*) tBuffer;
+	if (calibrateReads() != 0)
+	{
+		fprintf(stderr, "Error setting up tape reads!\n");
+		return(-1);
+	}
+
+	dbHdr = (MTF_DB_HDR*) tData;
 
 	if (dbHdr->type != MTF_TAPE)
 	{
@@ -135,12 +170,15 @@ INT32 readDataSet(void)
 {
 	INT32 result;
 	char *ptr;
+	UINT8 fdd;
+	struct mtop op;
 
 	if (verbose > 0) fprintf(stdout, "\nReading SSET block...\n");
 
 	filemark = 0;
+	pruneDir = 0;
 
-	dbHdr = (MTF_DB_HDR*) tBuffer;
+	dbHdr = (MTF_DB_HDR*) tData;
 
 	if (dbHdr->type != MTF_SSET)
 	{
@@ -151,6 +189,7 @@ INT32 readDataSet(void)
 	}
 
 	sset = (MTF_SSET_BLK*) dbHdr;
+	fdd = ((dbHdr->attr & MTF_FDD_EXISTS) != 0);
 
 	if (readStartOfSetBlock() != 0)
 	{
@@ -158,10 +197,39 @@ INT32 readDataSet(void)
 		return(-1);
 	}
 
+	/*
+	 * When listing a data set that has a media based catalog, space over its
+	 * data to the catalog following its ESET block instead of reading it.
+	 * A catalog being written (-X) needs every block, so it is read then.
+	 */
+
+	if ((list != 0) && (fdd != 0) && (mbcType != MTF_NO_MBC) &&
+	    (cataloging == 0) &&
+	    (filemark == 0) && (readerRunning == 0) &&
+	    ((tapeMapped == 0) || (softMarks != 0)))
+	{
+		if (verbose > 0)
+			fprintf(stdout, "Spacing to media based catalog...\n");
+
+		op.mt_op = MTFSF;
+		op.mt_count = 1;
+
+		if (positionTape(&op) == 0)
+		{
+			filemark = 1;
+			remaining = 0;
+			fddPending = 1;
+		}
+		else if (verbose > 0)
+		{
+			fprintf(stdout, "Unable to space over data set, reading it.\n");
+		}
+	}
+
 	result = 0;
 	while ((result == 0) && (filemark == 0))
 	{
-		dbHdr = (MTF_DB_HDR*) tBuffer;
+		dbHdr = (MTF_DB_HDR*) tData;
 
 		switch (dbHdr->type)
 		{
@@ -178,8 +246,15 @@ INT32 readDataSet(void)
 				break;
 
 			case MTF_FILE:
-				if (verbose > 0) fprintf(stdout, "\nReading FILE block...\n");
 				file = (MTF_FILE_BLK*) dbHdr;
+
+				if (pruneDir != 0)
+				{
+					result = skipFileBlock();
+					break;
+				}
+
+				if (verbose > 0) fprintf(stdout, "\nReading FILE block...\n");
 				result = readFileBlock();
 				break;
 
@@ -204,15 +279,29 @@ INT32 readDataSet(void)
 
 			case MTF_SFMB:
 				if (verbose > 0) fprintf(stdout, "\nReading SFMB block...\n");
-				sfmb = (MTF_SFMB_BLK*) dbHdr;
 				result = readSoftFileMarkBlock();
-				return(-1);
 				break;
 
 			default:
+				ptr = (char*) &dbHdr->type;
+
+				/* only vendor blocks and padding are skipped when verifying */
+				if ((verify != 0) &&
+				    ((headerSum(dbHdr, sizeof(MTF_DB_HDR) - sizeof(UINT16)) !=
+				      dbHdr->check) ||
+				     ((dbHdr->type != 0) &&
+				      ((!isalnum(*ptr)) || (!isalnum(*(ptr + 1))) ||
+				       (!isalnum(*(ptr + 2))) || (!isalnum(*(ptr + 3)))))))
+				{
+					fprintf(stderr,
+					        "Corrupt descriptor block header (type %08lX)!\n",
+					        dbHdr->type);
+					result = -1;
+					break;
+				}
+
 				if (verbose > 1)
 				{
-					ptr = (char*) &dbHdr->type;
 					if ((isalnum(*ptr)) && (isalnum(*(ptr + 1))) &&
 					    (isalnum(*(ptr + 2))) && (isalnum(*(ptr + 3))))
 					{
@@ -268,7 +357,7 @@ INT32 readEndOfDataSet(void)
 
 	filemark = 0;
 
-	dbHdr = (MTF_DB_HDR*) tBuffer;
+	dbHdr = (MTF_DB_HDR*) tData;
 
 	if (dbHdr->type != MTF_ESET)
 	{
@@ -280,7 +369,21 @@ INT32 readEndOfDataSet(void)
 
 	eset = (MTF_ESET_BLK*) dbHdr;
 
-	result = readNextBlock(0); 
+	if (checkBlock() != 0)
+		return(-1);
+
+	if (fddPending != 0)
+	{
+		fddPending = 0;
+
+		if (listMediaCatalog() != 0)
+		{
+			fprintf(stderr, "Error reading media based catalog!\n");
+			return(-1);
+		}
+	}
+
+	result = (filemark != 0) ? 1 : readNextBlock(0); 
 	while (result == 0)
 	{
 		result = readNextBlock(0); 
@@ -317,7 +420,10 @@ INT32 readEndOfDataSet(void)
 INT32 readTapeBlock(void)
 {
 	INT32 result;
-	char *ptr;
+	char *ptr, string[MAXPATHLEN + 1];
+
+	if (checkBlock() != 0)
+		return(-1);
 
 	if (tape->ver != 1)
 	{
@@ -345,21 +451,51 @@ INT32 readTapeBlock(void)
 	if (verbose > 0)
 	{
 		ptr = getString(dbHdr->strType, tape->name.size,
-						(UINT8*) tape + tape->name.offset);
+						(UINT8*) tape + tape->name.offset, string,
+						sizeof(string));
 		fprintf(stdout, "Media Name: %s\n", ptr);
 
 		ptr = getString(dbHdr->strType, tape->desc.size,
-						(UINT8*) tape + tape->desc.offset);
+						(UINT8*) tape + tape->desc.offset, string,
+						sizeof(string));
 		fprintf(stdout, "Media Description: %s\n", ptr);
 
 		ptr = getString(dbHdr->strType, tape->software.size,
-						(UINT8*) tape + tape->software.offset);
+						(UINT8*) tape + tape->software.offset, string,
+						sizeof(string));
 		fprintf(stdout, "Software: %s\n", ptr);
 	}
 
 	flbSize = tape->flbSize;
+	softMarks = ((tape->attr & MTF_TAPE_SOFT_FILEMARK_BIT) != 0);
 
-	if (dbHdr->off < flbSize)
+	if ((verbose > 0) && (softMarks != 0))
+		fprintf(stdout, "Tape was written with soft filemarks.\n");
+
+	if ((dbHdr->attr & MTF_FDD_ALLOWED) != 0)
+		mbcType = tape->catType;
+	else
+		mbcType = MTF_NO_MBC;
+
+	catalogTape();
+
+	result = 0;
+	if (softMarks != 0)
+	{
+		result = checkSoftBlockSize();
+		if (result < 0)
+			return(-1);
+	}
+
+	if (result > 0)
+	{
+		if (readNextBlock(0) != 1)
+		{
+			fprintf(stderr, "Error reading soft filemark!\n");
+			return(-1);
+		}
+	}
+	else if (dbHdr->off < flbSize)
 	{
 		stream = (MTF_STREAM_HDR*) ((char*) tape + dbHdr->off);
 		result = skipToNextBlock();
@@ -379,7 +515,7 @@ INT32 readTapeBlock(void)
 		}
 	}
 
-	if (tapeBlockSize < flbSize)
+	if ((tapeBlockSize < flbSize) && (softMarks == 0))
 	{
 		if (readNextBlock(0) != 1)
 		{
@@ -399,10 +535,54 @@ INT32 readTapeBlock(void)
 }
 
 
+/* checkSoftBlockSize() checks the tape block size against the SFMB block     */
+/* following the TAPE block, which starts the second tape block. Tape images  */
+/* and fixed block drives return as much as is asked for, so the first read   */
+/* may have taken in several tape blocks and been taken for one. If so the    */
+/* block size is corrected and the tape is positioned at the SFMB block, and  */
+/* 1 is returned.                                                             */
+
+static INT32 checkSoftBlockSize(void)
+{
+	UINT32 pos;
+	UINT64 pba;
+
+	for (pos = MIN_TAPE_BLOCK_SIZE; pos < tapeBlockSize;
+	     pos += MIN_TAPE_BLOCK_SIZE)
+	{
+		if ((pos + sizeof(MTF_SFMB_BLK) > remaining) ||
+		    (isSoftMark(&tData[pos], remaining - pos) == 0) ||
+		    (tapeBlockSize % pos != 0))
+			continue;
+
+		if (verbose > 0)
+			fprintf(stdout, "Soft filemark found after %lu bytes, reading "
+			        "%lu-byte tape blocks.\n", pos, pos);
+
+		tapeBlockSize = pos;
+
+		pba.least = 1;
+		pba.most = 0;
+
+		if (seekTape(&pba) != 0)
+			return(-1);
+
+		remaining = 0;
+
+		return(1);
+	}
+
+	return(0);
+}
+
+
 INT32 readStartOfSetBlock(void)
 {
 	INT32 result;
-	char *ptr;
+	char *ptr, string[MAXPATHLEN + 1];
+
+	if (checkBlock() != 0)
+		return(-1);
 
 	if (verbose > 1)
 	{
@@ -428,20 +608,29 @@ INT32 readStartOfSetBlock(void)
 	if (verbose > 0)
 	{
 		ptr = getString(dbHdr->strType, sset->name.size,
-						(UINT8*) sset + sset->name.offset);
+						(UINT8*) sset + sset->name.offset, string,
+						sizeof(string));
 		fprintf(stdout, "Data Set Name: %s\n", ptr);
 
 		ptr = getString(dbHdr->strType, sset->desc.size,
-						(UINT8*) sset + sset->desc.offset);
+						(UINT8*) sset + sset->desc.offset, string,
+						sizeof(string));
 		fprintf(stdout, "Data Set Description %s\n", ptr);
 
 		ptr = getString(dbHdr->strType, sset->user.size,
-						(UINT8*) sset + sset->user.offset);
+						(UINT8*) sset + sset->user.offset, string,
+						sizeof(string));
 		fprintf(stdout, "User Name: %s\n", ptr);
 	}
 
 	setCompress = sset->softCompress;
 
+	ptr = getString(dbHdr->strType, sset->name.size,
+	                (UINT8*) sset + sset->name.offset, string, sizeof(string));
+
+	if (catalogSet(ptr, tapeOffset() - remaining) != 0)
+		return(-1);
+
 	if (dbHdr->off < flbSize)
 	{
 		stream = (MTF_STREAM_HDR*) ((char*) sset + dbHdr->off);
@@ -469,7 +658,10 @@ INT32 readStartOfSetBlock(void)
 INT32 readVolumeBlock(void)
 {
 	INT32 result;
-	char *ptr;
+	char *ptr, string[MAXPATHLEN + 1];
+
+	if (checkBlock() != 0)
+		return(-1);
 
 	if (verbose > 1)
 	{
@@ -484,15 +676,18 @@ INT32 readVolumeBlock(void)
 	if (verbose > 0)
 	{
 		ptr = getString(dbHdr->strType, volb->device.size,
-						(UINT8*) volb + volb->device.offset);
+						(UINT8*) volb + volb->device.offset, string,
+						sizeof(string));
 		fprintf(stdout, "Device Name: %s\n", ptr);
 
 		ptr = getString(dbHdr->strType, volb->volume.size,
-						(UINT8*) volb + volb->volume.offset);
+						(UINT8*) volb + volb->volume.offset, string,
+						sizeof(string));
 		fprintf(stdout, "Volume Name: %s\n", ptr);
 
 		ptr = getString(dbHdr->strType, volb->machine.size,
-						(UINT8*) volb + volb->machine.offset);
+						(UINT8*) volb + volb->machine.offset, string,
+						sizeof(string));
 		fprintf(stdout, "Machine Name: %s\n", ptr);
 	}
 
@@ -523,8 +718,12 @@ INT32 readVolumeBlock(void)
 INT32 readDirectoryBlock(void)
 {
 	INT32 result;
-	char *ptr, *ptr2, fullPath[MAXPATHLEN + 1], tmpPath[MAXPATHLEN + 1];
-	struct stat sbuf;
+	char *ptr, fullPath[MAXPATHLEN + 1];
+	char string[MAXPATHLEN + 1];
+	struct utimbuf utbuf;
+
+	if (checkBlock() != 0)
+		return(-1);
 
 	if (verbose > 1)
 	{
@@ -541,10 +740,17 @@ INT32 readDirectoryBlock(void)
 	if ((dirb->attr & MTF_DIR_PATH_IN_STREAM_BIT) == 0)
 	{
 		ptr = getString(dbHdr->strType, dirb->name.size,
-		                (UINT8*) dirb + dirb->name.offset);
+		                (UINT8*) dirb + dirb->name.offset, string,
+		                sizeof(string));
 
 		strcpy(curPath, ptr);
 
+		if (catalogEntry(MTF_DIRB, ptr) != 0)
+			return(-1);
+
+		closeDir(curDir);
+		curDir = -1;
+
 		if (verbose > 0) fprintf(stdout, "Directory Name: %s\n", ptr);
 
 		if (forceCase == CASE_LOWER)
@@ -554,86 +760,32 @@ INT32 readDirectoryBlock(void)
 
 		sprintf(fullPath, "%s/%s", outPath, curPath);
 
-		if ((list == 0) && (matchCnt == 0))
-		{
-			if (stat(fullPath, &sbuf) != 0)
-			{
-				if (errno == ENOENT)
-				{
-					strcpy(tmpPath, fullPath);
-					ptr = strrchr(tmpPath, '/');
-					*ptr = '\0';
-					ptr2 = ptr;
-
-					result = (INT32) stat(tmpPath, &sbuf);
-					while (result != 0)
-					{
-						if (debug > 0) printf("%s did not exist\n", tmpPath);
-						if (errno != ENOENT) break;
-
-						ptr = strrchr(tmpPath, '/');
-						*ptr = '\0';
-
-						result = (INT32) stat(tmpPath, &sbuf);
-					}
+		pruneDir = ((selecting != 0) && (matchDir(curPath) == 0));
 
-					if (result != 0)
-					{
-						fprintf(stderr, "Error %d testing for status of %s!\n",
-								errno, tmpPath);
-						return(-1);
-					}
+		if ((pruneDir != 0) && (verbose > 0))
+			fprintf(stdout, "%s cannot match any patterns... skipping!\n",
+			        curPath);
 
-					while (ptr < ptr2)
-					{
-						*ptr = '/';
-
-						if (debug > 0) printf("creating %s...\n", tmpPath);
-
-						if (mkdir(tmpPath, 0777) != 0)
-						{
-							fprintf(stderr,
-									"Unable to create directory %s!\n",
-									tmpPath);
-							return(-1);
-						}
-
-						if ((owner != -1) || (group != -1))
-						{
-							if (chown(tmpPath, owner, group) != 0)
-							{
-								fprintf(stderr,
-										"Error %d setting owner/group of %s!\n",
-										errno, tmpPath);
-							}
-						}
-
-						while (*ptr != '\0') ptr += 1;
-					}
+		if ((list == 0) && (archiving != 0))
+		{
+			if (selecting == 0)
+			{
+				utbuf.actime = getTime(dirb->access);
+				utbuf.modtime = getTime(dirb->mod);
 
-					sprintf(fullPath, "%s/%s", outPath, curPath);
-				}
-				else
-				{
-					fprintf(stderr, "Error %d testing for status of %s!\n",
-					        errno, fullPath);
+				if (archiveDirectory(curPath, &utbuf) != 0)
 					return(-1);
-				}
 			}
-			else
-			{
-				if ((sbuf.st_mode & S_IFDIR) == 0)
-				{
-					fprintf(stderr, "%s is not a directory!\n", fullPath);
-					return(-1);
-				}
-
-			} /* if (stat(fullPath, &sbuf) != 0) */
+		}
+		else if ((list == 0) && (selecting == 0))
+		{
+			if (makePath(fullPath) != 0)
+				return(-1);
 
 			if (verbose > 0)
 				fprintf(stdout, "Current path changed to %s\n", fullPath);
 
-		} /* if ((list == 0) && (matchCnt == 0)) */
+		} /* if ((list == 0) && (selecting == 0)) */
 	}
 	else
 	{
@@ -666,17 +818,108 @@ INT32 readDirectoryBlock(void)
 }
 
 
+/* makePath() makes sure that a directory exists, creating it and any of its */
+/* parents that are missing. Directories found or created are remembered, so  */
+/* each one is tested for only once however many files are written to it.    */
+
+INT32 makePath(char *path)
+{
+	INT32 result;
+	char *ptr, *end, tmpPath[MAXPATHLEN + 1];
+	struct stat sbuf;
+
+	strcpy(tmpPath, path);
+
+	end = tmpPath + strlen(tmpPath);
+	while ((end > tmpPath + 1) && (*(end - 1) == '/'))
+	{
+		end -= 1;
+		*end = '\0';
+	}
+
+	if (knownDir(tmpPath) != 0)
+		return(0);
+
+	if (stat(tmpPath, &sbuf) == 0)
+	{
+		if ((sbuf.st_mode & S_IFDIR) == 0)
+		{
+			fprintf(stderr, "%s is not a directory!\n", tmpPath);
+			return(-1);
+		}
+
+		return(addDir(tmpPath));
+	}
+
+	if (errno != ENOENT)
+	{
+		fprintf(stderr, "Error %d testing for status of %s!\n", errno, tmpPath);
+		return(-1);
+	}
+
+	result = -1;
+	while (result != 0)
+	{
+		if (debug > 0) printf("%s did not exist\n", tmpPath);
+		if (errno != ENOENT) break;
+
+		ptr = strrchr(tmpPath, '/');
+		*ptr = '\0';
+
+		if (knownDir(tmpPath) != 0)
+			result = 0;
+		else
+			result = (INT32) stat(tmpPath, &sbuf);
+	}
+
+	if (result != 0)
+	{
+		fprintf(stderr, "Error %d testing for status of %s!\n", errno, tmpPath);
+		return(-1);
+	}
+
+	while (ptr < end)
+	{
+		*ptr = '/';
+
+		if (debug > 0) printf("creating %s...\n", tmpPath);
+
+		if (mkdir(tmpPath, 0777) != 0)
+		{
+			fprintf(stderr, "Unable to create directory %s!\n", tmpPath);
+			return(-1);
+		}
+
+		if ((owner != -1) || (group != -1))
+		{
+			if (chown(tmpPath, owner, group) != 0)
+			{
+				fprintf(stderr, "Error %d setting owner/group of %s!\n",
+				        errno, tmpPath);
+			}
+		}
+
+		if (addDir(tmpPath) != 0)
+			return(-1);
+
+		while (*ptr != '\0')
+			ptr += 1;
+	}
+
+	return(0);
+}
+
+
 INT32 readFileBlock(void)
 {
 	INT32 result;
-	char *ptr, *ptr2, filePath[MAXPATHLEN + 1], fullPath[MAXPATHLEN + 1];
-	char tmpPath[MAXPATHLEN + 1];
+	char *ptr, *name, filePath[MAXPATHLEN + 1], fullPath[MAXPATHLEN + 1];
+	char tmpPath[MAXPATHLEN + 1], string[MAXPATHLEN + 1];
 	int i, output;
-	struct tm tbuf;
 	struct utimbuf utbuf;
-	UINT32 threshold;
-	struct statfs fsbuf;
-	struct stat sbuf;
+
+	if (checkBlock() != 0)
+		return(-1);
 
 	if (verbose > 1)
 	{
@@ -708,23 +951,8 @@ INT32 readFileBlock(void)
 				MTF_DAY(file->access), MTF_YEAR(file->access));
 	}
 
-	tbuf.tm_sec = MTF_SECOND(file->mod);
-	tbuf.tm_min = MTF_MINUTE(file->mod);
-	tbuf.tm_hour = MTF_HOUR(file->mod);
-	tbuf.tm_mday = MTF_DAY(file->mod);
-	tbuf.tm_mon = MTF_MONTH(file->mod) - 1;
-	tbuf.tm_year = MTF_YEAR(file->mod) - 1900;
-
-	utbuf.modtime = mktime(&tbuf);
-
-	tbuf.tm_sec = MTF_SECOND(file->access);
-	tbuf.tm_min = MTF_MINUTE(file->access);
-	tbuf.tm_hour = MTF_HOUR(file->access);
-	tbuf.tm_mday = MTF_DAY(file->access);
-	tbuf.tm_mon = MTF_MONTH(file->access) - 1;
-	tbuf.tm_year = MTF_YEAR(file->access) - 1900;
-
-	utbuf.actime = mktime(&tbuf);
+	utbuf.modtime = getTime(file->mod);
+	utbuf.actime = getTime(file->access);
 
 	if (dbHdr->attr & MTF_COMPRESSION)
 		compressPossible = 1;
@@ -750,9 +978,13 @@ INT32 readFileBlock(void)
 	if ((file->attr & MTF_FILE_NAME_IN_STREAM_BIT) == 0)
 	{
 		ptr = getString(dbHdr->strType, file->name.size,
-						(UINT8*) file + file->name.offset);
+						(UINT8*) file + file->name.offset, string,
+						sizeof(string));
 
 		if (verbose > 0) fprintf(stdout, "File Name: %s\n", ptr);
+
+		if (catalogEntry(MTF_FILE, ptr) != 0)
+			return(-1);
 	}
 	else
 	{
@@ -769,19 +1001,11 @@ INT32 readFileBlock(void)
 		strupr(filePath);
 
 	sprintf(fullPath, "%s/%s", outPath, filePath);
+	name = &filePath[strlen(curPath)];
 
-	if (matchCnt > 0)
+	if (selecting != 0)
 	{
-		i = 0;
-		while ((i >= 0) && (i < matchCnt))
-		{
-			if (regexec(&match[i], filePath, 0, NULL, 0) != 0)
-				i += 1;
-			else
-				i = -1;
-		}
-		
-		if (i >= 0)
+		if (matchPath(filePath) == 0)
 		{
 			if (verbose > 0)
 				fprintf(stdout, "%s does not match any patterns... skipping!\n",
@@ -800,109 +1024,71 @@ INT32 readFileBlock(void)
 		}
 	}
 
-	if (list == 0)
+	if ((list == 0) && (archiving != 0))
+	{
+		if (verbose > 0)
+			fprintf(stdout, "File will be archived as %s\n", filePath);
+		else
+			fprintf(stdout, "%s\n", filePath);
+
+		if (beginArchiveFile(filePath, &utbuf) != 0)
+			return(-1);
+
+		output = ARCHIVE_FILE;
+	}
+	else if (list == 0)
 	{
 		if (verbose > 0)
 			fprintf(stdout, "File will be written to %s\n", fullPath);
 		else
 			fprintf(stdout, "%s\n", fullPath);
 		
-		if (matchCnt > 0)
+		if (selecting != 0)
 		{
 			strcpy(tmpPath, fullPath);
-
 			ptr = strrchr(tmpPath, '/');
 			*ptr = '\0';
-			ptr2 = ptr;
-			
-			result = (INT32) stat(tmpPath, &sbuf);
-			while (result != 0)
-			{
-				if (errno != ENOENT) break;
-
-				ptr = strrchr(tmpPath, '/');
-				*ptr = '\0';
 
-				result = (INT32) stat(tmpPath, &sbuf);
-			}
-
-			if (result != 0)
-			{
-				fprintf(stderr, "Error %d testing for status of %s!\n",
-						errno, tmpPath);
+			if (makePath(tmpPath) != 0)
 				return(-1);
-			}
-
-			while (ptr < ptr2)
-			{
-				*ptr = '/';
-
-				if (mkdir(tmpPath, 0777) != 0)
-				{
-					fprintf(stderr, "Unable to create directory %s!\n",
-							tmpPath);
-					return(-1);
-				}
-
-				if ((owner != -1) || (group != -1))
-				{
-					if (chown(tmpPath, owner, group) != 0)
-					{
-						fprintf(stderr, "Error %d setting owner/group of %s!\n",
-								errno, filePath);
-					}
-				}
-
-				while (*ptr != '\0')
-					ptr += 1;
-			}
 		}
 
-		if (minFree != 0)
+		if (curDir == -1)
 		{
-			strcpy(filePath, fullPath);
-			ptr = strrchr(filePath, '/');
-			*ptr = '\0';
+			sprintf(tmpPath, "%s/%s", outPath, curPath);
 
-			if (statfs(filePath, &fsbuf) != 0)
+			curDir = openDir(tmpPath);
+			if (curDir == -1)
 			{
-				if (debug > 0) printf("filePath=%s\n", filePath);
-				fprintf(stderr, "Error testing for free space!\n");
+				fprintf(stderr, "Error %d opening directory %s!\n",
+				        errno, tmpPath);
 				return(-1);
 			}
+		}
 
-			threshold = (minFree + (UINT32) fsbuf.f_bsize - 1) /
-				(UINT32) fsbuf.f_bsize;
-
-			if (debug > 0)
-				printf("threshold=%lu avail=%ld\n", threshold, fsbuf.f_bavail);
-
-			while ((UINT32) fsbuf.f_bavail < threshold)
-			{
-				fprintf(stderr, "Free space is only %ld bytes!\n",
-						fsbuf.f_bavail * fsbuf.f_bsize);
-				sleep(60);
+		if (waitForSpace(curDir) != 0)
+			return(-1);
 
-				if (statfs(filePath, &fsbuf) != 0)
-				{
-					fprintf(stderr, "Error testing for free space!\n");
-					return(-1);
-				}
+		if (workers > 0)
+		{
+			if (beginJob(curDir, name, fullPath) != 0)
+				return(-1);
 
-				if (debug > 0) printf("avail=%ld\n", fsbuf.f_bavail);
-			}
+			output = DEFERRED_FILE;
 		}
-
-		output = open(fullPath, O_WRONLY | O_TRUNC | O_CREAT,
-					  S_IRWXU | S_IRWXG | S_IRWXO);
-		if (output == -1)
+		else
 		{
-			fprintf(stderr, "Error %d opening/creating %s for writing!\n",
-					errno, fullPath);
-			return(-1);
+			output = openat(curDir, name, O_WRONLY | O_TRUNC | O_CREAT,
+						    S_IRWXU | S_IRWXG | S_IRWXO);
+			if (output == -1)
+			{
+				fprintf(stderr, "Error %d opening/creating %s for writing!\n",
+						errno, fullPath);
+				return(-1);
+			}
 		}
 
-		if ((owner != -1) || (group != -1))
+		if ((output != DEFERRED_FILE) && ((owner != -1) || (group != -1)))
 		{
 			if (fchown(output, owner, group) != 0)
 			{
@@ -920,6 +1106,9 @@ INT32 readFileBlock(void)
 
 	if (list == 0)
 	{
+		sparseFile = 0;
+		dataEnd = 0;
+
 		while ((stream->id != MTF_STAN) && (stream->id != MTF_SPAD))
 		{
 			result = skipOverStream();
@@ -929,7 +1118,7 @@ INT32 readFileBlock(void)
 				return(-1);
 			}
 
-			stream = (MTF_STREAM_HDR*) &tBuffer[result];
+			stream = (MTF_STREAM_HDR*) &tData[result];
 		}
 
 		if (stream->id == MTF_STAN)
@@ -948,20 +1137,36 @@ INT32 readFileBlock(void)
 
 			while ((result % flbSize) != 0)
 			{
-				stream = (MTF_STREAM_HDR*) &tBuffer[result];
-				result = skipOverStream();
-				if (result < 0)
+				stream = (MTF_STREAM_HDR*) &tData[result];
+
+				if (stream->id == MTF_SPAR)
 				{
-					fprintf(stderr, "Error traversing stream!\n");
-					return(-1);
-				}
+					if (verbose > 1)
+						fprintf(stdout, "Reading SPAR stream...\n");
 
-				if (debug > 0)
-					printf("skipOverStream() returned %ld\n", result);
-			}
-		}
-		else
-		{
+					result = writeData(output);
+					if (result < 0)
+					{
+						fprintf(stderr, "Error writing stream to file!\n");
+						return(-1);
+					}
+				}
+				else
+				{
+					result = skipOverStream();
+					if (result < 0)
+					{
+						fprintf(stderr, "Error traversing stream!\n");
+						return(-1);
+					}
+				}
+
+				if (debug > 0)
+					printf("skipOverStream() returned %ld\n", result);
+			}
+		}
+		else
+		{
 			result = skipOverStream();
 			if (result < 0)
 			{
@@ -980,7 +1185,48 @@ INT32 readFileBlock(void)
 		}
 	}
 
-	if (list == 0)
+	if ((list == 0) && (flushData() != 0))
+	{
+		fprintf(stderr, "Error writing %s!\n", fullPath);
+		return(-1);
+	}
+
+	if ((list == 0) && (sparseFile != 0) && (output != ARCHIVE_FILE))
+	{
+		i = (output == DEFERRED_FILE) ? jobFile() : output;
+
+		if ((i == -1) || (ftruncate(i, dataEnd) != 0))
+		{
+			fprintf(stderr, "Error %d setting size of %s!\n", errno, fullPath);
+			return(-1);
+		}
+	}
+
+	if ((list == 0) && (output == ARCHIVE_FILE))
+	{
+		if (finishArchiveFile() != 0)
+		{
+			fprintf(stderr, "Error archiving %s!\n", filePath);
+			return(-1);
+		}
+	}
+	else if ((list == 0) && (output == DEFERRED_FILE))
+	{
+		if (finishJob(&utbuf) != 0)
+		{
+			fprintf(stderr, "Error writing %s!\n", fullPath);
+			return(-1);
+		}
+	}
+	else if ((list == 0) && (asyncIO != 0))
+	{
+		if (asyncClose(output, fullPath, &utbuf) != 0)
+		{
+			fprintf(stderr, "Error writing %s!\n", fullPath);
+			return(-1);
+		}
+	}
+	else if (list == 0)
 	{
 		if (close(output) != 0)
 		{
@@ -989,7 +1235,7 @@ INT32 readFileBlock(void)
 			return(-1);
 		}
 
-		result = utime(fullPath, &utbuf);
+		result = setTimes(curDir, name, &utbuf);
 		if (result != 0)
 		{
 			fprintf(stderr,
@@ -1019,6 +1265,9 @@ INT32 readCorruptObjectBlock(void)
 {
 	INT32 result;
 
+	if (checkBlock() != 0)
+		return(-1);
+
 	if (verbose > 1)
 	{
 		fprintf(stdout, "Descriptor Block Attributes: %08lX\n", dbHdr->attr);
@@ -1057,6 +1306,9 @@ INT32 readEndOfSetPadBlock(void)
 {
 	INT32 result;
 
+	if (checkBlock() != 0)
+		return(-1);
+
 	if (verbose > 1)
 	{
 		fprintf(stdout, "Descriptor Block Attributes: %08lX\n", dbHdr->attr);
@@ -1127,6 +1379,9 @@ INT32 readEndOfSetBlock(void)
 
 INT32 readEndOfTapeMarkerBlock(void)
 {
+	if (checkBlock() != 0)
+		return(-1);
+
 	if (verbose > 1)
 	{
 		fprintf(stdout, "Descriptor Block Attributes: %08lX\n", dbHdr->attr);
@@ -1159,56 +1414,58 @@ INT32 readEndOfTapeMarkerBlock(void)
 }
 
 
+/* readSoftFileMarkBlock() reads an SFMB block, which stands in for a        */
+/* filemark on media written with soft filemarks, and notes the addresses of  */
+/* the soft filemarks in its table. It returns 1, as readNextBlock() does     */
+/* for a filemark.                                                            */
+
 INT32 readSoftFileMarkBlock(void)
 {
+	sfmb = (MTF_SFMB_BLK*) tData;
+
 	if (verbose > 1)
 	{
-		fprintf(stdout, "Descriptor Block Attributes: %08lX\n", dbHdr->attr);
+		fprintf(stdout, "Descriptor Block Attributes: %08lX\n",
+		        sfmb->common.attr);
 		fprintf(stdout, "Format Logical Address: %lu:%lu\n",
-				dbHdr->fla.most, dbHdr->fla.least);
-		fprintf(stdout, "Offset To First Event: %u\n", dbHdr->off);
-		fprintf(stdout, "String Type: %u\n", dbHdr->strType);
-		fprintf(stdout, "OS: %u\n", dbHdr->osId);
+				sfmb->common.fla.most, sfmb->common.fla.least);
+		fprintf(stdout, "Number Of Filemark Entries: %lu\n", sfmb->marks);
+		fprintf(stdout, "Filemark Entries Used: %lu\n", sfmb->used);
 	}
 
-	if (dbHdr->off < flbSize)
-	{
-		stream = (MTF_STREAM_HDR*) ((char*) dirb + dbHdr->off);
-		if (skipToNextBlock() != 0)
-		{
-			fprintf(stderr, "Error traversing to end of descriptor block!\n");
-			return(-1);
-		}
-	}
-	else
-	{
-		if (readNextBlock(dbHdr->off) != 1)
-		{
-			fprintf(stderr, "Error reading tape block!\n");
-			return(-1);
-		}
-	}
-	
-	return(0);
+	noteSoftMarks(tData, remaining);
+
+	if (verbose > 0) fprintf(stdout, "Read soft filemark.\n");
+
+	/* the rest of the tape block holding it is padding */
+	filemark = 1;
+	remaining = 0;
+
+	return(1);
 }
 
 
 /* readNextBlock() keeps track of how many logical blocks have been used from */
 /* the last tape block read. If needed, it reads another tape block in. The   */
-/* global variable, remaining, is used to track how much data remains in the  */
-/* block buffer.                                                              */
-
-INT32 readNextBlock(UINT16 advance)
+/* global variable, tData, is the read cursor into the block buffer and the   */
+/* global variable, remaining, is used to track how much data remains after   */
+/* it. Consuming logical blocks only moves the cursor; the data is moved back */
+/* to the start of the buffer only when a tape block must be appended and     */
+/* there is no room left after it. When the tape is mapped into memory the    */
+/* cursor points into the mapping and nothing is copied at all.               */
+
+INT32 readNextBlock(UINT32 advance)
 {
+	UINT8 *ptr;
 	ssize_t result;
 	struct mtop op;
 	struct mtget get;
 
-	if (debug > 0) printf("advance=%u remaining=%u\n", advance, remaining);
+	if (debug > 0) printf("advance=%lu remaining=%lu\n", advance, remaining);
 
 	if ((advance == 0) || (remaining == 0) || (advance == remaining))
 	{
-		if (debug > 0)
+		if ((debug > 0) && (readerRunning == 0))
 		{
 			op.mt_op = MTNOP;
 			op.mt_count = 0;
@@ -1229,14 +1486,15 @@ INT32 readNextBlock(UINT16 advance)
 			printf("tape block no. %u\n", get.mt_blkno);
 		}
 
+		tData = tBuffer;
 		remaining = 0;
 
 		if (flbSize == 0) /* first block of tape, don't know flbSize yet */
 		{
 			if (tapeBlockSize == 0)
-				result = read(mtfd, tBuffer, MAX_TAPE_BLOCK_SIZE);
+				result = readTape(&tData, MAX_TAPE_BLOCK_SIZE);
 			else
-				result = read(mtfd, tBuffer, tapeBlockSize);
+				result = readTape(&tData, tapeBlockSize);
 
 			if (result < 0)
 			{
@@ -1251,13 +1509,13 @@ INT32 readNextBlock(UINT16 advance)
 				tapeBlockSize = result;
 
 				if (verbose > 0)
-					fprintf(stdout, "Detected %u-byte tape block size.\n",
-					        tapeBlockSize);
+					fprintf(stdout, "Detected %lu-byte tape block size.\n",
+					        (UINT32) tapeBlockSize);
 			}
 		}
 		else
 		{
-			result = read(mtfd, &tBuffer[remaining], tapeBlockSize);
+			result = readTape(&tData, tapeBlockSize);
 
 			if (result < 0)
 			{
@@ -1278,7 +1536,8 @@ INT32 readNextBlock(UINT16 advance)
 
 			while (remaining < flbSize)
 			{
-				result = read(mtfd, &tBuffer[remaining], tapeBlockSize);
+				ptr = &tData[remaining];
+				result = readTape(&ptr, tapeBlockSize);
 
 				if (result < 0)
 				{
@@ -1307,19 +1566,34 @@ INT32 readNextBlock(UINT16 advance)
 
 		if (debug > 0)
 		{
-			printf("remaining=%u\n", remaining);
-		dump("lastblock.dmp");
-	}
+			printf("remaining=%lu\n", remaining);
+			dump("lastblock.dmp");
+		}
 
 		blockCnt += 1;
+
+		if ((softMarks != 0) && (isSoftMark(tData, remaining) != 0))
+			return(readSoftFileMarkBlock());
 	}
 	else if (advance > remaining)
 	{
 		while (advance > remaining)
 		{
-			if (debug > 0) printf("reading %u bytes...\n", tapeBlockSize);
+			if ((tapeMapped == 0) &&
+			    ((tData - tBuffer) + remaining + tapeBlockSize >
+			     TAPE_BUFFER_SIZE))
+			{
+				if (debug > 0) printf("moving %lu bytes...\n", remaining);
 
-			result = read(mtfd, &tBuffer[remaining], tapeBlockSize);
+				memmove(tBuffer, tData, remaining);
+				tData = tBuffer;
+			}
+
+			if (debug > 0)
+				printf("reading %lu bytes...\n", (UINT32) tapeBlockSize);
+
+			ptr = &tData[remaining];
+			result = readTape(&ptr, tapeBlockSize);
 
 			if (result < 0)
 			{
@@ -1339,20 +1613,23 @@ INT32 readNextBlock(UINT16 advance)
 			remaining += result;
 		}
 
-		if (debug > 0) printf("remaining=%u\n", remaining);
+		if (debug > 0) printf("remaining=%lu\n", remaining);
 	}
 	else
 	{
 		if (advance % flbSize != 0)
 		{
-			fprintf(stderr, "Illegal read request (%u bytes)!\n", advance);
+			fprintf(stderr, "Illegal read request (%lu bytes)!\n", advance);
 			return(-1);
 		}
 
-		if (debug > 0) printf("advancing %u bytes...\n", advance);
+		if (debug > 0) printf("advancing %lu bytes...\n", advance);
 
+		tData += advance;
 		remaining -= advance;
-		memmove(tBuffer, tBuffer + advance, remaining);
+
+		if ((softMarks != 0) && (isSoftMark(tData, remaining) != 0))
+			return(readSoftFileMarkBlock());
 	}
 
 	return(0);
@@ -1378,7 +1655,7 @@ INT32 skipToNextBlock(void)
 			return(-1);
 		}
 
-		stream = (MTF_STREAM_HDR*) &tBuffer[offset];
+		stream = (MTF_STREAM_HDR*) &tData[offset];
 	}
 
 	if (stream->id == MTF_STAN)
@@ -1390,7 +1667,7 @@ INT32 skipToNextBlock(void)
 			return(-1);
 		}
 
-		stream = (MTF_STREAM_HDR*) &tBuffer[offset];
+		stream = (MTF_STREAM_HDR*) &tData[offset];
 
 		if ((offset % flbSize) != 0)
 		{
@@ -1403,7 +1680,7 @@ INT32 skipToNextBlock(void)
 					return(-1);
 				}
 
-				stream = (MTF_STREAM_HDR*) &tBuffer[offset];
+				stream = (MTF_STREAM_HDR*) &tData[offset];
 			}
 
 			offset = skipOverStream();
@@ -1434,19 +1711,42 @@ INT32 skipToNextBlock(void)
 }
 
 
+/* skipFileBlock() skips a FILE block in a directory that no pattern can     */
+/* match, without looking at its name.                                        */
+
+INT32 skipFileBlock(void)
+{
+	if (checkBlock() != 0)
+		return(-1);
+
+	if (debug > 0) printf("skipping FILE block\n");
+
+	stream = (MTF_STREAM_HDR*) ((char*) file + dbHdr->off);
+
+	if (skipToNextBlock() != 0)
+	{
+		fprintf(stderr, "Error traversing to end of FILE block!\n");
+		return(-1);
+	}
+
+	return(0);
+}
+
+
 /* skipOverStream() skips over the current stream. It returns the number of   *//* bytes to skip in the last tape block read.                                 */
 
 INT32 skipOverStream(void)
 {
 	char *ptr;
 	INT32 result;
-	UINT32 offset, bytes;
+	UINT32 offset, bytes, taken;
+	UINT8 sum[4];
 	MTF_STREAM_HDR hdr;
 
-	offset = (char*) stream - (char*) tBuffer;
+	offset = (char*) stream - (char*) tData;
 	offset += sizeof(MTF_STREAM_HDR);
 
-	if (debug > 0) printf("offset=%lu remaining=%u\n", offset, remaining);
+	if (debug > 0) printf("offset=%lu remaining=%lu\n", offset, remaining);
 
 	if (offset >= remaining)
 	{
@@ -1468,7 +1768,7 @@ INT32 skipOverStream(void)
 			ptr = (char*) &hdr;
 			ptr += bytes;
 
-			memcpy(ptr, tBuffer, offset);
+			memcpy(ptr, tData, offset);
 		}
 	}
 	else
@@ -1499,7 +1799,12 @@ INT32 skipOverStream(void)
 		fprintf(stdout, "Data Compression: %u\n", hdr.compress);
 	}
 
-	if (debug > 0) printf("remaining=%u\n", remaining);
+	if (checkStream(&hdr) != 0)
+		return(-1);
+
+	if (debug > 0) printf("remaining=%lu\n", remaining);
+
+	taken = 0;
 
 	if (hdr.length.most == 0)
 	{
@@ -1513,6 +1818,12 @@ INT32 skipOverStream(void)
 	if (debug > 0)
 		printf("skipping %lu bytes from offset %lu...\n", bytes, offset);
 
+	sumData(&tData[offset], bytes);
+	takeSum(sum, &taken, &tData[offset], bytes);
+
+	if (keepData(&tData[offset], bytes) != 0)
+		return(-1);
+
 	decrement64(&hdr.length, bytes);
 
 	if (debug > 0)
@@ -1545,6 +1856,12 @@ INT32 skipOverStream(void)
 			if (debug > 0)
 				printf("skipping %lu bytes from offset 0...\n", bytes);
 
+			sumData(tData, bytes);
+			takeSum(sum, &taken, tData, bytes);
+
+			if (keepData(tData, bytes) != 0)
+				return(-1);
+
 			decrement64(&hdr.length, bytes);
 
 			if (debug > 0)
@@ -1555,6 +1872,9 @@ INT32 skipOverStream(void)
 		offset = bytes;
 	}
 
+	if ((hdr.id == MTF_CSUM) && (matchSum(sum, taken) != 0))
+		return(-1);
+
 	if ((offset % 4) != 0)
 		offset += 4 - (offset % 4);
 
@@ -1578,21 +1898,63 @@ INT32 skipOverStream(void)
 }
 
 
+/* readStream() reads the data of the current stream into memory, for streams */
+/* such as the media based catalog that are parsed rather than written to a  */
+/* file. It returns the data, which the caller frees, and sets *offset as     */
+/* skipOverStream() would return it.                                          */
+
+UINT8 *readStream(UINT32 *length, INT32 *offset)
+{
+	UINT8 *data;
+
+	kept = NULL;
+	keptLen = 0;
+	keptMax = 0;
+	keeping = 1;
+
+	*offset = skipOverStream();
+
+	keeping = 0;
+	data = kept;
+	kept = NULL;
+
+	if (*offset < 0)
+	{
+		free(data);
+		return(NULL);
+	}
+
+	if (data == NULL)
+		data = (UINT8*) malloc(1);
+
+	*length = keptLen;
+
+	return(data);
+}
+
+
 /* writeData() reads the contents of a the current stream (which should be a  */
-/* STAN stream) and writes it to a file. It returns the number of bytes that  */
-/* were written from the last tape block read.                                */
+/* STAN or SPAR stream) and writes it to a file. The data of a SPAR stream is */
+/* preceded by its offset in the file, so a sparse file is written region by  */
+/* region with holes left between them. It returns the number of bytes that   */
+/* were written from the last tape block read. When the tape is a mapped      */
+/* image the data is copied by copyTape() and the blocks are only stepped     */
+/* over.                                                                      */
 
 INT32 writeData(int file)
 {
 	char *ptr;
 	INT32 result;
 	UINT32 offset, bytes;
+	UINT8 copied, compressed;
+	UINT64 where;
+	off_t start, end, written;
 	MTF_STREAM_HDR hdr;
 
-	offset = (char*) stream - (char*) tBuffer;
+	offset = (char*) stream - (char*) tData;
 	offset += sizeof(MTF_STREAM_HDR);
 
-	if (debug > 0) printf("offset=%lu remaining=%u\n", offset, remaining);
+	if (debug > 0) printf("offset=%lu remaining=%lu\n", offset, remaining);
 
 	if (offset >= remaining)
 	{
@@ -1614,7 +1976,7 @@ INT32 writeData(int file)
 			ptr = (char*) &hdr;
 			ptr += bytes;
 
-			memcpy(ptr, tBuffer, offset);
+			memcpy(ptr, tData, offset);
 		}
 	}
 	else
@@ -1632,84 +1994,207 @@ INT32 writeData(int file)
 		fprintf(stdout, "Data Compression: %u\n", hdr.compress);
 	}
 
-	if ((compressPossible) && ((hdr.mediaAttr & MTF_STREAM_COMPRESSED) != 0))
-	{
-		fprintf(stderr, "Compressed streams are not supported!\n");
+	if (checkStream(&hdr) != 0)
 		return(-1);
+
+	compressed = ((compressPossible != 0) &&
+	              ((hdr.mediaAttr & MTF_STREAM_COMPRESSED) != 0));
+
+	if (((hdr.sysAttr & MTF_STREAM_IS_SPARSE) != 0) || (hdr.id == MTF_SPAR))
+		sparseFile = 1;
+
+	if (debug > 0) printf("remaining=%lu\n", remaining);
+
+	if (file == ARCHIVE_FILE)
+	{
+		if (sparseFile != 0)
+			skipArchiveFile("is sparse and cannot be archived");
+
+		if ((compressed == 0) && (archiveSize(&hdr.length) != 0))
+			return(-1);
 	}
 
-	if ((hdr.sysAttr & MTF_STREAM_IS_SPARSE) != 0)
+	if ((file == DEFERRED_FILE) && ((sparseFile != 0) || (compressed != 0) ||
+	    (hdr.length.most > 0) || (hdr.length.least > POOL_FILE_LIMIT)))
 	{
-		fprintf(stderr, "Sparse streams are not supported!\n");
-		return(-1);
+		file = jobFile();
+		if (file == -1)
+			return(-1);
 	}
 
-	if (debug > 0) printf("remaining=%u\n", remaining);
+	start = 0;
 
-	if (hdr.length.most == 0)
+	if (hdr.id == MTF_SPAR)
 	{
-		bytes = min(hdr.length.least, remaining - offset);
+		if ((hdr.length.most == 0) && (hdr.length.least < sizeof(UINT64)))
+		{
+			fprintf(stderr, "Sparse stream is too short!\n");
+			return(-1);
+		}
+
+		bytes = min(sizeof(UINT64), remaining - offset);
+		memcpy(&where, &tData[offset], bytes);
+		sumData(&tData[offset], bytes);
+		offset += bytes;
+
+		if (bytes < sizeof(UINT64))
+		{
+			result = readNextBlock(0);
+			if (result != 0)
+			{
+				fprintf(stderr, "Error reading tape block!\n");
+				return(-1);
+			}
+
+			ptr = (char*) &where;
+			memcpy(ptr + bytes, tData, sizeof(UINT64) - bytes);
+			sumData(tData, sizeof(UINT64) - bytes);
+			offset = sizeof(UINT64) - bytes;
+		}
+
+		decrement64(&hdr.length, sizeof(UINT64));
+
+		start = ((off_t) where.most << 32) + (off_t) where.least;
+
+		if (debug > 0)
+			printf("sparse region at %lu:%lu\n", where.most, where.least);
+
+		if ((file != ARCHIVE_FILE) && (seekData(file, start) != 0))
+		{
+			fprintf(stderr, "Error %d seeking in file!\n", errno);
+			return(-1);
+		}
 	}
-	else
+
+	if (compressed == 0)
 	{
-		bytes = remaining - offset;
+		end = start + ((off_t) hdr.length.most << 32) +
+		      (off_t) hdr.length.least;
+		dataEnd = max(dataEnd, end);
 	}
 
-	if (debug > 0)
-		printf("writing %lu bytes from offset %lu...\n", bytes, offset);
+	copied = 0;
 
-	if (write(file, &tBuffer[offset], bytes) != bytes)
-	{
-		fprintf(stderr, "Error writing file!\n");
+	if ((tapeMapped != 0) && (asyncIO == 0) && (compressed == 0) &&
+	    (file >= 0) && (curDir != -1) && (waitForSpace(curDir) != 0))
 		return(-1);
-	}
 
-	decrement64(&hdr.length, bytes);
+	/* data is only copied whole if the free space allows for all of it */
+	if ((tapeMapped != 0) && (asyncIO == 0) && (compressed == 0) &&
+	    (file >= 0) && (haveSpace(&hdr.length) != 0))
+	{
+		if (flushData() != 0)
+		{
+			fprintf(stderr, "Error writing file!\n");
+			return(-1);
+		}
 
-	if (debug > 0)
-		printf("%lu:%lu not yet written\n", hdr.length.most, hdr.length.least);
+		result = copyTape(file, &tData[offset], &hdr.length);
+		if (result < 0)
+		{
+			fprintf(stderr, "Error writing file!\n");
+			return(-1);
+		}
 
-	if ((hdr.length.most == 0) && (hdr.length.least == 0))
+		copied = (result == 0);
+	}
+
+	if ((copied == 0) && (preallocate != 0) && (sparseFile == 0) &&
+	    (compressed == 0) && (file >= 0))
 	{
-		offset += bytes;
+		if (reserveData(file, &hdr.length) != 0)
+			return(-1);
+	}
+
+	if (compressed != 0)
+	{
+		result = readCompressed(file, offset, &hdr.length, &written);
+		if (result < 0)
+			return(-1);
+
+		offset = result;
+		dataEnd = max(dataEnd, start + written);
 	}
 	else
 	{
-		while ((hdr.length.most > 0) || (hdr.length.least > 0))
+		if (hdr.length.most == 0)
 		{
-			result = readNextBlock(0); 
-			if (result != 0)
-			{
-				fprintf(stderr, "Error reading tape block!\n");
-				return(-1);
-			}
+			bytes = min(hdr.length.least, remaining - offset);
+		}
+		else
+		{
+			bytes = remaining - offset;
+		}
 
-			if (hdr.length.most == 0)
-			{
-				bytes = min(hdr.length.least, remaining);
-			}
-			else
-			{
-				bytes = remaining;
-			}
+		if (debug > 0)
+			printf("writing %lu bytes from offset %lu...\n", bytes, offset);
 
-			if (debug > 0)
-				printf("writing %lu bytes from offset 0...\n", bytes);
+		sumData(&tData[offset], bytes);
 
-			if (write(file, tBuffer, bytes) != bytes)
-			{
-				fprintf(stderr, "Error writing file!\n");
-				return(-1);
-			}
+		if ((copied == 0) && (putData(file, &tData[offset], bytes) != 0))
+		{
+			fprintf(stderr, "Error writing file!\n");
+			return(-1);
+		}
 
-			decrement64(&hdr.length, bytes);
+		spendSpace(bytes);
 
-			if (debug > 0)
-				printf("%lu:%lu not yet written\n", hdr.length.most,
-				       hdr.length.least);
+		decrement64(&hdr.length, bytes);
+
+		if (debug > 0)
+			printf("%lu:%lu not yet written\n", hdr.length.most,
+			       hdr.length.least);
+
+		if ((hdr.length.most == 0) && (hdr.length.least == 0))
+		{
+			offset += bytes;
 		}
+		else
+		{
+			while ((hdr.length.most > 0) || (hdr.length.least > 0))
+			{
+				result = readNextBlock(0); 
+				if (result != 0)
+				{
+					fprintf(stderr, "Error reading tape block!\n");
+					return(-1);
+				}
 
-		offset = bytes;
+				if (hdr.length.most == 0)
+				{
+					bytes = min(hdr.length.least, remaining);
+				}
+				else
+				{
+					bytes = remaining;
+				}
+
+				if ((copied == 0) && (curDir != -1) &&
+				    (waitForSpace(curDir) != 0))
+					return(-1);
+
+				if (debug > 0)
+					printf("writing %lu bytes from offset 0...\n", bytes);
+
+				sumData(tData, bytes);
+
+				if ((copied == 0) && (putData(file, tData, bytes) != 0))
+				{
+					fprintf(stderr, "Error writing file!\n");
+					return(-1);
+				}
+
+				spendSpace(bytes);
+
+				decrement64(&hdr.length, bytes);
+
+				if (debug > 0)
+					printf("%lu:%lu not yet written\n", hdr.length.most,
+					       hdr.length.least);
+			}
+
+			offset = bytes;
+		}
 	}
 
 	if ((offset % 4) != 0)
@@ -1735,48 +2220,502 @@ INT32 writeData(int file)
 }
 
 
-/* getString() fetches a string stored after a descriptor block. If the       */
-/* string is type 2, it is converted from unicode to ascii. Also, any nulls   */
-/* are replaced with '/' characters. A pointer to the string is returned. If  */
-/* the string is longer than the maximum supported, an empty string is        */
-/* returned.                                                                  */
+/* reserveData() allocates the whole of a file before it is written, so that */
+/* it is laid out in as few extents as possible and a restore that would run */
+/* out of space fails before writing anything. Filesystems that cannot       */
+/* allocate space in advance are written as before.                          */
 
-char *getString(UINT8 type, UINT16 length, UINT8 *addr)
+INT32 reserveData(int file, UINT64 *length)
 {
-	char *ptr1, *ptr2;
-	
-	static char buffer[MAXPATHLEN + 1]; 
+	off_t total;
+
+	static UINT8 unsupported = 0;
+
+	total = ((off_t) length->most << 32) + (off_t) length->least;
+
+	if ((unsupported != 0) || (total == 0))
+		return(0);
+
+	if (fallocate(file, 0, 0, total) == 0)
+		return(0);
 
-	if ((length == 0) || (length > MAXPATHLEN))
+	if ((errno == EOPNOTSUPP) || (errno == ENOSYS))
 	{
-		buffer[0] = '\0';
+		if (debug > 0) printf("fallocate() unsupported\n");
+
+		unsupported = 1;
+		return(0);
 	}
+
+	if ((errno == ENOSPC) || (errno == EDQUOT) || (errno == EFBIG))
+		fprintf(stderr, "Not enough space for a file of %lu:%lu bytes!\n",
+		        length->most, length->least);
 	else
+		fprintf(stderr, "Error %d allocating space for file!\n", errno);
+
+	return(-1);
+}
+
+
+/* putData() writes bytes of a stream to a file, through io_uring when       */
+/* asynchronous I/O was selected. Data for DEFERRED_FILE is collected for the */
+/* worker threads and data for ARCHIVE_FILE is added to the archive.          */
+/* Otherwise it is staged, so that the pieces a stream is read in are written */
+/* STAGE_SIZE bytes at a time, or in a single write for a smaller file.       */
+/* Staged data is written out by flushData().                                 */
+
+INT32 putData(int file, UINT8 *data, UINT32 bytes)
+{
+	if (file == DEFERRED_FILE)
+		return(jobWrite(data, bytes));
+
+	if (file == ARCHIVE_FILE)
+		return(archiveWrite(data, bytes));
+
+	if (asyncIO != 0)
+		return(asyncWrite(file, data, bytes));
+
+	if ((stageFile != file) && (flushData() != 0))
+		return(-1);
+
+	if (stage == NULL)
+	{
+		stage = (UINT8*) malloc(STAGE_SIZE);
+		if (stage == NULL)
+		{
+			fprintf(stderr, "Memory error while writing file!\n");
+			return(-1);
+		}
+	}
+
+	if ((staged + bytes > STAGE_SIZE) && (flushData() != 0))
+		return(-1);
+
+	stageFile = file;
+
+	if (bytes >= STAGE_SIZE)
+		return(writeAll(file, data, bytes));
+
+	memcpy(&stage[staged], data, bytes);
+	staged += bytes;
+
+	return(0);
+}
+
+
+/* flushData() writes out the data staged by putData(). It must be called     */
+/* before the file is closed, truncated or written any other way.             */
+
+INT32 flushData(void)
+{
+	INT32 result;
+
+	if (staged == 0)
+		return(0);
+
+	result = writeAll(stageFile, stage, staged);
+	staged = 0;
+
+	return(result);
+}
+
+
+/* writeAll() writes bytes to a file, retrying after short writes.            */
+
+INT32 writeAll(int file, UINT8 *data, size_t bytes)
+{
+	ssize_t result;
+
+	while (bytes > 0)
 	{
-		memcpy(buffer, addr, length);
-		buffer[length] = '\0';
+		result = write(file, data, bytes);
+		if (result <= 0)
+			return(-1);
 
-		if (type == 2)
+		data += result;
+		bytes -= result;
+	}
+
+	return(0);
+}
+
+
+/* seekData() moves the file offset at which the next data of a sparse file  */
+/* is written. The bytes skipped are never written, leaving a hole.           */
+
+INT32 seekData(int file, off_t offset)
+{
+	if (asyncIO != 0)
+		return(asyncSeek(file, offset));
+
+	if (flushData() != 0)
+		return(-1);
+
+	if (lseek(file, offset, SEEK_SET) == (off_t) -1)
+		return(-1);
+
+	return(0);
+}
+
+
+/* getString() fetches a string stored after a descriptor block into buffer, */
+/* which holds size bytes, and returns it. If the string is type 2, it is     */
+/* converted from UTF-16LE to UTF-8 and any nulls are replaced with '/'       */
+/* characters. Runs of ASCII are converted eight characters at a time where   */
+/* SSE2 is available. If the string does not fit, an empty string is          */
+/* returned.                                                                  */
+
+char *getString(UINT8 type, UINT16 length, UINT8 *addr, char *buffer,
+                size_t size)
+{
+	UINT32 unit, next;
+	size_t in, out;
+#ifdef __SSE2__
+	__m128i data, zero, mask;
+#endif
+
+	if (type != 2)
+	{
+		if ((length == 0) || (length >= size))
+		{
+			buffer[0] = '\0';
+		}
+		else
 		{
-			length -= 1;
+			memcpy(buffer, addr, length);
+			buffer[length] = '\0';
+		}
+
+		return(buffer);
+	}
+
+#ifdef __SSE2__
+	zero = _mm_setzero_si128();
+	mask = _mm_set1_epi16((short) 0xFF80);
+#endif
 
-			ptr1 = &buffer[1];
-			ptr2 = &buffer[2];
+	in = 0;
+	out = 0;
+
+	while (in + 1 < length)
+	{
+#ifdef __SSE2__
+		if ((in + 16 <= length) && (out + 8 < size))
+		{
+			data = _mm_loadu_si128((__m128i*) &addr[in]);
 
-			while (ptr2 - buffer < length)
+			if ((_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(data, mask),
+			                                       zero)) == 0xFFFF) &&
+			    (_mm_movemask_epi8(_mm_cmpeq_epi16(data, zero)) == 0))
 			{
-				*ptr1 = *ptr2;
+				_mm_storel_epi64((__m128i*) &buffer[out],
+				                 _mm_packus_epi16(data, data));
+				in += 16;
+				out += 8;
+				continue;
+			}
+		}
+#endif
 
-				if (*ptr1 == '\0')
-					*ptr1 = '/';
+		unit = (UINT32) addr[in] | ((UINT32) addr[in + 1] << 8);
+		in += 2;
+
+		if ((unit >= 0xD800) && (unit < 0xDC00) && (in + 1 < length))
+		{
+			next = (UINT32) addr[in] | ((UINT32) addr[in + 1] << 8);
 
-				ptr1 += 1;
-				ptr2 += 2;
+			if ((next >= 0xDC00) && (next < 0xE000))
+			{
+				unit = 0x10000 + ((unit - 0xD800) << 10) + (next - 0xDC00);
+				in += 2;
 			}
+		}
 
-			*ptr1 = '\0';
+		if ((unit >= 0xD800) && (unit < 0xE000))
+			unit = 0xFFFD;
+
+		if (out + 4 >= size)
+		{
+			buffer[0] = '\0';
+			return(buffer);
+		}
+
+		if (unit == 0)
+		{
+			buffer[out++] = '/';
+		}
+		else if (unit < 0x80)
+		{
+			buffer[out++] = (char) unit;
+		}
+		else if (unit < 0x800)
+		{
+			buffer[out++] = (char) (0xC0 | (unit >> 6));
+			buffer[out++] = (char) (0x80 | (unit & 0x3F));
+		}
+		else if (unit < 0x10000)
+		{
+			buffer[out++] = (char) (0xE0 | (unit >> 12));
+			buffer[out++] = (char) (0x80 | ((unit >> 6) & 0x3F));
+			buffer[out++] = (char) (0x80 | (unit & 0x3F));
+		}
+		else
+		{
+			buffer[out++] = (char) (0xF0 | (unit >> 18));
+			buffer[out++] = (char) (0x80 | ((unit >> 12) & 0x3F));
+			buffer[out++] = (char) (0x80 | ((unit >> 6) & 0x3F));
+			buffer[out++] = (char) (0x80 | (unit & 0x3F));
 		}
 	}
 
+	buffer[out] = '\0';
+
 	return(buffer);
 }
+
+
+/* waitForSpace() keeps minFree bytes free on the filesystem holding dir.     */
+/* Free space is estimated from the bytes written since it was last checked,  */
+/* and statfs() is only called again after checkInterval bytes or when the    */
+/* estimate falls below minFree. When space runs low, writing pauses until    */
+/* resumeFree bytes are free, checking every FREE_POLL_USEC microseconds; the */
+/* reader thread keeps filling its ring from tape while it waits.             */
+
+INT32 waitForSpace(int dir)
+{
+	struct statfs fsbuf;
+	UINT8 paused;
+
+	if (minFree == 0)
+		return(0);
+
+	if ((freeKnown != 0) && (sinceCheck < checkInterval) &&
+	    (freeSpace >= minFree))
+		return(0);
+
+	paused = 0;
+
+	while (1)
+	{
+		if (fstatfs(dir, &fsbuf) != 0)
+		{
+			fprintf(stderr, "Error testing for free space!\n");
+			return(-1);
+		}
+
+		freeSpace = (unsigned long long) fsbuf.f_bavail *
+		            (unsigned long long) fsbuf.f_bsize;
+		sinceCheck = 0;
+		freeKnown = 1;
+
+		if (debug > 0) printf("avail=%llu\n", freeSpace);
+
+		if (freeSpace >= ((paused != 0) ? resumeFree : minFree))
+			break;
+
+		if (paused == 0)
+		{
+			fprintf(stderr,
+			        "Free space is only %llu bytes; waiting for %lu bytes...\n",
+			        freeSpace, resumeFree);
+			paused = 1;
+		}
+
+		usleep(FREE_POLL_USEC);
+	}
+
+	if ((paused != 0) && (verbose > 0))
+		fprintf(stdout, "Free space is %llu bytes; resuming.\n", freeSpace);
+
+	return(0);
+}
+
+
+/* spendSpace() charges bytes written against the estimate of free space.     */
+
+void spendSpace(UINT32 bytes)
+{
+	sinceCheck += bytes;
+
+	if (freeSpace > bytes)
+		freeSpace -= bytes;
+	else
+		freeSpace = 0;
+
+	return;
+}
+
+
+/* haveSpace() tells whether length bytes can be written without going below */
+/* minFree or past the next check of free space, judged by the estimate.      */
+
+static INT32 haveSpace(UINT64 *length)
+{
+	unsigned long long bytes;
+
+	if (minFree == 0)
+		return(1);
+
+	bytes = ((unsigned long long) length->most << 32) +
+	        (unsigned long long) length->least;
+
+	return((freeKnown != 0) && (freeSpace >= minFree) &&
+	       (freeSpace - minFree >= bytes) &&
+	       (sinceCheck + bytes < checkInterval));
+}
+
+
+/* checkBlock() verifies the checksum of the current descriptor block header  */
+/* when checksums are being verified.                                         */
+
+INT32 checkBlock(void)
+{
+	char *ptr;
+
+	if (verify == 0)
+		return(0);
+
+	if (headerSum(dbHdr, sizeof(MTF_DB_HDR) - sizeof(UINT16)) != dbHdr->check)
+	{
+		ptr = (char*) &dbHdr->type;
+		fprintf(stderr, "Checksum of %c%c%c%c block header does not match!\n",
+		        *ptr, *(ptr + 1), *(ptr + 2), *(ptr + 3));
+		return(-1);
+	}
+
+	return(0);
+}
+
+
+/* checkStream() verifies the checksum of a stream header and, if the stream  */
+/* is followed by a CSUM stream, starts summing its data. A CSUM stream keeps */
+/* the sum of the stream before it.                                           */
+
+INT32 checkStream(MTF_STREAM_HDR *hdr)
+{
+	if (verify == 0)
+		return(0);
+
+	if (headerSum(hdr, sizeof(MTF_STREAM_HDR) - sizeof(UINT16)) != hdr->check)
+	{
+		fprintf(stderr, "Checksum of stream header does not match!\n");
+		return(-1);
+	}
+
+	if (hdr->id == MTF_CSUM)
+	{
+		summing = 0;
+	}
+	else
+	{
+		summing = ((hdr->mediaAttr & MTF_STREAM_CHECKSUMED) != 0);
+		summed = summing;
+		streamSum = 0;
+		sumPhase = 0;
+	}
+
+	return(0);
+}
+
+
+/* sumData() adds data of the current stream to its checksum, the exclusive-  */
+/* or of its 32-bit words. Data that does not start on a word boundary of the */
+/* stream has its sum rotated into place.                                     */
+
+void sumData(UINT8 *data, UINT32 bytes)
+{
+	UINT32 sum;
+
+	if (summing == 0)
+		return;
+
+	sum = xorWords(data, bytes);
+
+	if (sumPhase != 0)
+		sum = ((sum << (sumPhase * 8)) | (sum >> (32 - sumPhase * 8))) &
+		      0xFFFFFFFFUL;
+
+	streamSum ^= sum;
+	sumPhase = (sumPhase + bytes) % 4;
+
+	return;
+}
+
+
+/* keepData() adds data of the current stream to the copy being made by      */
+/* readStream().                                                              */
+
+static INT32 keepData(UINT8 *data, UINT32 bytes)
+{
+	UINT8 *ptr;
+
+	if (keeping == 0)
+		return(0);
+
+	if (keptLen + bytes > keptMax)
+	{
+		keptMax = max(keptMax * 2, keptLen + bytes);
+
+		ptr = (UINT8*) realloc(kept, keptMax);
+		if (ptr == NULL)
+		{
+			fprintf(stderr, "Memory error while reading stream!\n");
+			return(-1);
+		}
+
+		kept = ptr;
+	}
+
+	memcpy(&kept[keptLen], data, bytes);
+	keptLen += bytes;
+
+	return(0);
+}
+
+
+/* takeSum() collects the first bytes of a CSUM stream's data.               */
+
+void takeSum(UINT8 *sum, UINT32 *taken, UINT8 *data, UINT32 bytes)
+{
+	UINT32 count;
+
+	count = min(bytes, 4 - *taken);
+	memcpy(&sum[*taken], data, count);
+	*taken += count;
+
+	return;
+}
+
+
+/* matchSum() compares the checksum in a CSUM stream with the sum of the data */
+/* of the stream before it.                                                   */
+
+INT32 matchSum(UINT8 *sum, UINT32 taken)
+{
+	UINT32 expected;
+
+	if ((verify == 0) || (summed == 0))
+		return(0);
+
+	summed = 0;
+
+	if (taken < 4)
+	{
+		fprintf(stderr, "Checksum stream is too short!\n");
+		return(-1);
+	}
+
+	expected = (UINT32) sum[0] | ((UINT32) sum[1] << 8) |
+	           ((UINT32) sum[2] << 16) | ((UINT32) sum[3] << 24);
+
+	if (debug > 0)
+		printf("checksum %08lX, expected %08lX\n", streamSum, expected);
+
+	if (expected != streamSum)
+	{
+		fprintf(stderr, "Checksum of stream data does not match!\n");
+		return(-1);
+	}
+
+	return(0);
+}
@@ -0,0 +1,558 @@
+/*
+
+mtf - a Microsoft Tape Format reader (and future writer?)
+Copyright (C) 1999  D. Alan Stewart, Layton Graphics, Inc.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+Contact the author at:
+
+D. Alan Stewart
+Layton Graphics, Inc.
+155 Woolco Dr.
+Marietta, GA 30062, USA
+astewart@layton-graphics.com
+
+See mtf.c for version history, contributors, etc.
+
+**
+**	mtfscan.c
+**
+**	functions for listing a tape image with several threads, each finding
+**	the descriptor blocks in its own part of the image, and for listing the
+**	data sets of an image by following its descriptor blocks
+**
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include <string.h>
+#include <pthread.h>
+#include "mtf.h"
+
+
+extern char outPath[MAXPATHLEN + 1], curPath[MAXPATHLEN + 1];
+extern UINT8 verbose, debug, forceCase, selecting;
+extern UINT16 setNum, flbSize, workers;
+extern MTF_DB_HDR *dbHdr;
+extern MTF_TAPE_BLK *tape;
+extern MTF_SSET_BLK *sset;
+extern MTF_DIRB_BLK *dirb;
+extern MTF_FILE_BLK *file;
+
+
+typedef struct
+{
+	size_t		start;		/* first byte of the part */
+	size_t		end;		/* first byte past the part */
+	size_t		next;		/* end of the last block found */
+	size_t		*found;		/* offsets of the descriptor blocks found */
+	size_t		count;		/* number of them */
+	size_t		max;		/* room in found */
+	INT32		result;		/* -1 if memory ran out */
+	UINT8		started;	/* part is being scanned by its own thread */
+	pthread_t	thread;
+} SCAN_PART;
+
+
+static UINT8 *image;
+static size_t imageSize;
+static UINT8 skipSet, pruneDir;
+
+
+static void *scanMain(void*);
+static void scanPart(SCAN_PART*);
+static size_t findBlock(size_t);
+static size_t endOfBlock(size_t);
+static INT32 isBlock(size_t);
+static size_t findEntry(SCAN_PART*, size_t);
+static INT32 listBlock(size_t);
+
+
+/* scanImage() lists the files in a tape image. The image is split into      */
+/* parts on format logical block boundaries and each part is scanned by its  */
+/* own thread, which finds the first descriptor block in it by its type and  */
+/* header checksum and follows the blocks from there, stepping over each     */
+/* block's streams. The parts are then listed in order. Where the blocks     */
+/* followed from the previous part do not lead to the first block found in a */
+/* part (because the thread took data that looked like a descriptor block   */
+/* for one), the part is scanned again from the right place.                 */
+
+INT32 scanImage(void)
+{
+	SCAN_PART *parts;
+	size_t length, pos, i;
+	UINT16 count, part;
+	INT32 result;
+
+	image = tapeImage(&imageSize);
+	if (image == NULL)
+		return(-1);
+
+	if (isBlock(0) == 0)
+	{
+		fprintf(stderr, "Tape image does not start with a descriptor block!\n");
+		return(-1);
+	}
+
+	dbHdr = (MTF_DB_HDR*) image;
+	tape = (MTF_TAPE_BLK*) image;
+
+	if ((dbHdr->type != MTF_TAPE) || (tape->flbSize < MIN_TAPE_BLOCK_SIZE) ||
+	    (tape->flbSize % MIN_TAPE_BLOCK_SIZE != 0))
+	{
+		fprintf(stderr, "Tape image does not start with a TAPE block!\n");
+		return(-1);
+	}
+
+	flbSize = tape->flbSize;
+
+	count = (UINT16) min(workers, imageSize / SCAN_PART_SIZE);
+	if (count == 0)
+		count = 1;
+
+	length = imageSize / count;
+	length -= length % flbSize;
+
+	parts = (SCAN_PART*) calloc(count, sizeof(SCAN_PART));
+	if (parts == NULL)
+	{
+		fprintf(stderr, "Memory error while scanning tape image!\n");
+		return(-1);
+	}
+
+	if (verbose > 0)
+		fprintf(stdout, "Scanning tape image with %u threads...\n", count);
+
+	for (part = 0; part < count; part += 1)
+	{
+		parts[part].start = part * length;
+		parts[part].end = (part == count - 1) ? imageSize : (part + 1) * length;
+
+		if ((part > 0) &&
+		    (pthread_create(&parts[part].thread, NULL, scanMain,
+		                    &parts[part]) == 0))
+			parts[part].started = 1;
+	}
+
+	scanPart(&parts[0]);
+
+	catalogTape();
+
+	skipSet = 0;
+	pruneDir = 0;
+	pos = 0;
+	result = 0;
+
+	for (part = 0; part < count; part += 1)
+	{
+		if (parts[part].started != 0)
+			pthread_join(parts[part].thread, NULL);
+		else if (part > 0)
+			scanPart(&parts[part]);
+
+		if (result != 0)
+			continue;
+
+		if (parts[part].result != 0)
+		{
+			fprintf(stderr, "Memory error while scanning tape image!\n");
+			result = -1;
+			continue;
+		}
+
+		pos = findBlock(pos);
+		if (pos >= parts[part].end)
+			continue;
+
+		i = findEntry(&parts[part], pos);
+		if (i == parts[part].count)
+		{
+			if (debug > 0)
+				printf("rescanning part %u from %lu\n", part, (UINT32) pos);
+
+			parts[part].start = pos;
+			scanPart(&parts[part]);
+			i = 0;
+
+			if (parts[part].result != 0)
+			{
+				fprintf(stderr, "Memory error while scanning tape image!\n");
+				result = -1;
+				continue;
+			}
+		}
+
+		for (; (i < parts[part].count) && (result == 0); i += 1)
+			result = listBlock(parts[part].found[i]);
+
+		pos = parts[part].next;
+	}
+
+	for (part = 0; part < count; part += 1)
+		free(parts[part].found);
+
+	free(parts);
+
+	return((result < 0) ? -1 : 0);
+}
+
+
+/* scanSets() prints the data sets in a tape image that has no filemarks to   */
+/* space over, following its descriptor blocks from the start and pairing     */
+/* each SSET block with the ESET block that ends its data set. It returns 1,  */
+/* having printed nothing, if the image was written with soft filemarks.      */
+
+INT32 scanSets(void)
+{
+	MTF_SSET_BLK *start;
+	MTF_DB_HDR *hdr;
+	size_t pos;
+	unsigned long long first, last;
+	char *ptr, string[MAXPATHLEN + 1];
+
+	image = tapeImage(&imageSize);
+	if (image == NULL)
+		return(-1);
+
+	hdr = (MTF_DB_HDR*) image;
+	tape = (MTF_TAPE_BLK*) image;
+
+	if ((isBlock(0) == 0) || (hdr->type != MTF_TAPE) ||
+	    (tape->flbSize < MIN_TAPE_BLOCK_SIZE) ||
+	    (tape->flbSize % MIN_TAPE_BLOCK_SIZE != 0))
+	{
+		fprintf(stderr, "Tape image does not start with a TAPE block!\n");
+		return(-1);
+	}
+
+	if ((tape->attr & MTF_TAPE_SOFT_FILEMARK_BIT) != 0)
+		return(1);
+
+	flbSize = tape->flbSize;
+
+	start = NULL;
+	pos = findBlock(0);
+
+	while (pos < imageSize)
+	{
+		hdr = (MTF_DB_HDR*) &image[pos];
+
+		if (hdr->type == MTF_SSET)
+		{
+			start = (MTF_SSET_BLK*) hdr;
+		}
+		else if ((hdr->type == MTF_ESET) && (start != NULL))
+		{
+			ptr = getString(start->common.strType, start->name.size,
+			                (UINT8*) start + start->name.offset, string,
+			                sizeof(string));
+
+			first = ((unsigned long long) start->common.fla.most << 32) +
+			        (unsigned long long) start->common.fla.least;
+			last = ((unsigned long long) hdr->fla.most << 32) +
+			       (unsigned long long) hdr->fla.least;
+
+			printSet(start->num, ptr, start->attr, start->date,
+			         (last - first) * flbSize);
+
+			start = NULL;
+		}
+		else if (hdr->type == MTF_EOTM)
+		{
+			break;
+		}
+
+		pos = findBlock(endOfBlock(pos));
+	}
+
+	return(0);
+}
+
+
+static void *scanMain(void *arg)
+{
+	scanPart((SCAN_PART*) arg);
+
+	return(NULL);
+}
+
+
+/* scanPart() finds the descriptor blocks starting in a part of the image.    */
+/* The last of them may run past the end of the part, and where it ends is   */
+/* kept for the next part to be checked against.                             */
+
+static void scanPart(SCAN_PART *part)
+{
+	size_t pos, *found;
+
+	part->count = 0;
+	part->result = 0;
+
+	pos = findBlock(part->start);
+
+	while (pos < part->end)
+	{
+		if (part->count == part->max)
+		{
+			found = (size_t*) realloc(part->found, sizeof(size_t) *
+			                          (part->max + 1024));
+			if (found == NULL)
+			{
+				part->result = -1;
+				return;
+			}
+
+			part->found = found;
+			part->max += 1024;
+		}
+
+		part->found[part->count] = pos;
+		part->count += 1;
+
+		pos = findBlock(endOfBlock(pos));
+	}
+
+	part->next = pos;
+
+	return;
+}
+
+
+/* findBlock() returns the offset of the first descriptor block at or after   */
+/* pos, or the size of the image if there is none.                           */
+
+static size_t findBlock(size_t pos)
+{
+	pos = ((pos + flbSize - 1) / flbSize) * flbSize;
+
+	while ((pos < imageSize) && (isBlock(pos) == 0))
+		pos += flbSize;
+
+	return(min(pos, imageSize));
+}
+
+
+/* endOfBlock() returns the offset of the format logical block following the */
+/* descriptor block at pos and its streams. It stops early at a stream whose */
+/* header checksum is wrong, leaving findBlock() to resynchronize.           */
+
+static size_t endOfBlock(size_t pos)
+{
+	MTF_DB_HDR *hdr;
+	MTF_STREAM_HDR *hdrStream;
+	unsigned long long length;
+	size_t at;
+
+	hdr = (MTF_DB_HDR*) &image[pos];
+	at = pos + hdr->off;
+
+	if ((hdr->type == MTF_SFMB) || (hdr->off < sizeof(MTF_DB_HDR)))
+		return(pos + flbSize);
+
+	while (at + sizeof(MTF_STREAM_HDR) <= imageSize)
+	{
+		hdrStream = (MTF_STREAM_HDR*) &image[at];
+
+		if (headerSum(hdrStream, sizeof(MTF_STREAM_HDR) - sizeof(UINT16)) !=
+		    hdrStream->check)
+			break;
+
+		length = ((unsigned long long) hdrStream->length.most << 32) +
+		         (unsigned long long) hdrStream->length.least;
+		if (length > imageSize - at - sizeof(MTF_STREAM_HDR))
+			break;
+
+		at += sizeof(MTF_STREAM_HDR) + (size_t) length;
+		at += (4 - at % 4) % 4;
+
+		if (hdrStream->id == MTF_SPAD)
+			break;
+	}
+
+	return(max(at, pos + flbSize));
+}
+
+
+/* isBlock() tells whether a descriptor block starts at pos: its type must be */
+/* one of those in the format and its header checksum must be right.         */
+
+static INT32 isBlock(size_t pos)
+{
+	MTF_DB_HDR *hdr;
+
+	if (pos + sizeof(MTF_DB_HDR) > imageSize)
+		return(0);
+
+	hdr = (MTF_DB_HDR*) &image[pos];
+
+	switch (hdr->type)
+	{
+		case MTF_TAPE:
+		case MTF_SSET:
+		case MTF_VOLB:
+		case MTF_DIRB:
+		case MTF_FILE:
+		case MTF_CFIL:
+		case MTF_ESPB:
+		case MTF_ESET:
+		case MTF_EOTM:
+		case MTF_SFMB:
+			break;
+
+		default:
+			return(0);
+	}
+
+	return(headerSum(hdr, sizeof(MTF_DB_HDR) - sizeof(UINT16)) == hdr->check);
+}
+
+
+/* findEntry() returns the index of the block found at pos in a part, or the */
+/* number of blocks found if it is not one of them.                          */
+
+static size_t findEntry(SCAN_PART *part, size_t pos)
+{
+	size_t low, high, mid;
+
+	low = 0;
+	high = part->count;
+
+	while (low < high)
+	{
+		mid = (low + high) / 2;
+
+		if (part->found[mid] < pos)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if ((low < part->count) && (part->found[low] == pos))
+		return(low);
+
+	return(part->count);
+}
+
+
+/* listBlock() lists the descriptor block at pos as readDataSet() would, and */
+/* enters it into the catalog. It returns 1 at the end of the tape.          */
+
+static INT32 listBlock(size_t pos)
+{
+	char *ptr, string[MAXPATHLEN + 1];
+	char filePath[MAXPATHLEN + 1];
+
+	dbHdr = (MTF_DB_HDR*) &image[pos];
+
+	switch (dbHdr->type)
+	{
+		case MTF_SSET:
+			sset = (MTF_SSET_BLK*) dbHdr;
+			skipSet = ((setNum != 0) && (sset->num != setNum));
+			pruneDir = 0;
+
+			if (skipSet != 0)
+				break;
+
+			ptr = getString(dbHdr->strType, sset->name.size,
+			                (UINT8*) sset + sset->name.offset, string,
+			                sizeof(string));
+
+			if (verbose > 0)
+				fprintf(stdout, "Data Set %u: %s\n", sset->num, ptr);
+
+			return(catalogSet(ptr, pos));
+
+		case MTF_DIRB:
+			if (skipSet != 0)
+				break;
+
+			dirb = (MTF_DIRB_BLK*) dbHdr;
+
+			if ((dirb->attr & MTF_DIR_PATH_IN_STREAM_BIT) != 0)
+			{
+				/* not implemented */
+				fprintf(stderr, "Reading from stream not implemented!\n");
+				return(-1);
+			}
+
+			ptr = getString(dbHdr->strType, dirb->name.size,
+			                (UINT8*) dirb + dirb->name.offset, string,
+			                sizeof(string));
+
+			strcpy(curPath, ptr);
+
+			if (catalogEntry(MTF_DIRB, ptr) != 0)
+				return(-1);
+
+			if (forceCase == CASE_LOWER)
+				strlwr(curPath);
+			else if (forceCase == CASE_UPPER)
+				strupr(curPath);
+
+			pruneDir = ((selecting != 0) && (matchDir(curPath) == 0));
+			break;
+
+		case MTF_FILE:
+			if ((skipSet != 0) || (pruneDir != 0))
+				break;
+
+			file = (MTF_FILE_BLK*) dbHdr;
+
+			if ((file->attr & MTF_FILE_CORRUPT_BIT) != 0)
+				break;
+
+			if ((file->attr & MTF_FILE_NAME_IN_STREAM_BIT) != 0)
+			{
+				/* not implemented */
+				fprintf(stderr, "Reading from stream not implemented!\n");
+				return(-1);
+			}
+
+			ptr = getString(dbHdr->strType, file->name.size,
+			                (UINT8*) file + file->name.offset, string,
+			                sizeof(string));
+
+			if (catalogEntry(MTF_FILE, ptr) != 0)
+				return(-1);
+
+			if (snprintf(filePath, sizeof(filePath), "%s%s", curPath, ptr) >=
+			    (int) sizeof(filePath))
+			{
+				fprintf(stderr, "Path of %s is too long!\n", ptr);
+				return(-1);
+			}
+
+			if (forceCase == CASE_LOWER)
+				strlwr(filePath);
+			else if (forceCase == CASE_UPPER)
+				strupr(filePath);
+
+			if ((selecting != 0) && (matchPath(filePath) == 0))
+				break;
+
+			fprintf(stdout, "%s/%s\n", outPath, filePath);
+			break;
+
+		case MTF_EOTM:
+			return(1);
+	}
+
+	return(0);
+}
@@ -0,0 +1,446 @@
+/*
+
+mtf - a Microsoft Tape Format reader (and future writer?)
+Copyright (C) 1999  D. Alan Stewart, Layton Graphics, Inc.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+Contact the author at:
+
+D. Alan Stewart
+Layton Graphics, Inc.
+155 Woolco Dr.
+Marietta, GA 30062, USA
+astewart@layton-graphics.com
+
+See mtf.c for version history, contributors, etc.
+
+**
+**	mtfset.c
+**
+**	functions for finding the data sets on a tape without reading their data:
+**	listing them, and positioning the tape at one of them
+**
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/mtio.h>
+#include <string.h>
+#include "mtf.h"
+
+
+extern UINT8 verbose, debug, tapeMapped, softMarks;
+extern UINT16 flbSize, mbcType;
+extern UINT32 remaining;
+extern UINT8 *tData;
+extern int filemark;
+extern MTF_DB_HDR *dbHdr;
+extern MTF_SSET_BLK *sset;
+extern MTF_ESET_BLK *eset;
+extern MTF_EOTM_BLK *eotm;
+extern MTF_STREAM_HDR *stream;
+
+
+static INT32 mapSets(UINT16);
+static INT32 walkSets(void);
+static INT32 findLastEset(void);
+static UINT8 *readSetMap(UINT32*);
+static INT32 rewindSets(void);
+static INT32 spaceTape(int, int);
+static INT32 readAfterSeek(void);
+
+
+/* listSets() prints the data sets on the tape: their number, name, type,     */
+/* date and size. The set map of a media based catalog describes every set,  */
+/* so if there is one only the last ESET block is read. Otherwise the tape is */
+/* spaced from filemark to filemark and only each set's SSET and ESET blocks  */
+/* are read. The tape must be at the first data set.                          */
+
+INT32 listSets(void)
+{
+	INT32 result;
+
+	result = mapSets(0);
+	if (result <= 0)
+		return(result);
+
+	return(walkSets());
+}
+
+
+/* seekSet() positions the tape at the SSET block of data set num. With a set */
+/* map it is found from the set's physical block address and sought with      */
+/* MTSEEK. It returns 1, having left the tape at the first data set, if the   */
+/* set must be found by spacing over filemarks instead.                       */
+
+INT32 seekSet(UINT16 num)
+{
+	if (verbose > 0)
+		fprintf(stdout, "Seeking to data set #%u...\n", num);
+
+	return(mapSets(num));
+}
+
+
+/* mapSets() finds the set map in the last ESET block on the tape. It prints  */
+/* it if num is 0, and otherwise seeks to data set num. It returns 1, having  */
+/* left the tape at the first data set, if there is no set map to use.       */
+
+static INT32 mapSets(UINT16 num)
+{
+	MTF_SM_HDR *hdr;
+	MTF_SM_ENTRY *entry;
+	UINT8 *data, strType;
+	UINT32 length, pos;
+	UINT16 i;
+	char *ptr, string[MAXPATHLEN + 1];
+
+	if ((mbcType == MTF_NO_MBC) || ((tapeMapped != 0) && (softMarks == 0)))
+		return(1);
+
+	if (findLastEset() != 0)
+		return(rewindSets());
+
+	strType = dbHdr->strType;
+
+	data = readSetMap(&length);
+	if ((data == NULL) || (length < sizeof(MTF_SM_HDR)))
+	{
+		free(data);
+		return(rewindSets());
+	}
+
+	hdr = (MTF_SM_HDR*) data;
+	pos = sizeof(MTF_SM_HDR);
+	entry = NULL;
+
+	for (i = 0; i < hdr->count; i += 1)
+	{
+		entry = (MTF_SM_ENTRY*) &data[pos];
+
+		if ((pos + sizeof(MTF_SM_ENTRY) > length) ||
+		    (entry->length < sizeof(MTF_SM_ENTRY)) ||
+		    (pos + entry->length > length))
+		{
+			fprintf(stderr, "Set map is truncated!\n");
+			free(data);
+			return(-1);
+		}
+
+		if ((UINT32) entry->name.offset + entry->name.size > entry->length)
+		{
+			fprintf(stderr, "Set map is corrupt!\n");
+			free(data);
+			return(-1);
+		}
+
+		if (num == 0)
+		{
+			ptr = getString(strType, entry->name.size,
+			                (UINT8*) entry + entry->name.offset, string,
+			                sizeof(string));
+
+			printSet(entry->num, ptr, entry->attr, entry->date,
+			         ((unsigned long long) entry->size.most << 32) +
+			         (unsigned long long) entry->size.least);
+		}
+		else if (entry->num == num)
+		{
+			break;
+		}
+
+		pos += entry->length;
+	}
+
+	if (num == 0)
+	{
+		free(data);
+		return(0);
+	}
+
+	if (i == hdr->count)
+	{
+		fprintf(stderr, "Data set #%u is not on this tape!\n", num);
+		free(data);
+		return(-1);
+	}
+
+	if (debug > 0)
+		printf("data set %u is at block %lu:%lu\n", num, entry->pba.most,
+		       entry->pba.least);
+
+	if ((seekTape(&entry->pba) != 0) || (readAfterSeek() != 0))
+	{
+		free(data);
+		return(-1);
+	}
+
+	free(data);
+
+	dbHdr = (MTF_DB_HDR*) tData;
+	sset = (MTF_SSET_BLK*) dbHdr;
+
+	if ((dbHdr->type != MTF_SSET) || (sset->num != num))
+	{
+		if (verbose > 0)
+			fprintf(stdout, "Set map does not match tape, spacing instead.\n");
+
+		return(rewindSets());
+	}
+
+	return(0);
+}
+
+
+/* walkSets() prints the data sets by spacing from each SSET block to the    */
+/* ESET block following it, and from there to the next SSET block.           */
+
+static INT32 walkSets(void)
+{
+	INT32 result;
+	UINT16 num;
+	UINT32 attr;
+	MTF_DATE_TIME date;
+	unsigned long long start, end;
+	char *ptr, string[MAXPATHLEN + 1];
+
+	filemark = 0;
+	dbHdr = (MTF_DB_HDR*) tData;
+
+	while ((filemark == 0) && (dbHdr->type == MTF_SSET))
+	{
+		sset = (MTF_SSET_BLK*) dbHdr;
+
+		if (checkBlock() != 0)
+			return(-1);
+
+		ptr = getString(dbHdr->strType, sset->name.size,
+		                (UINT8*) sset + sset->name.offset, string,
+		                sizeof(string));
+
+		num = sset->num;
+		attr = sset->attr;
+		memcpy(date, sset->date, sizeof(date));
+		start = ((unsigned long long) dbHdr->fla.most << 32) +
+		        (unsigned long long) dbHdr->fla.least;
+
+		if ((spaceTape(MTFSF, 1) != 0) || (readNextBlock(0) != 0))
+		{
+			fprintf(stderr, "Error spacing to end of data set #%u!\n", num);
+			return(-1);
+		}
+
+		dbHdr = (MTF_DB_HDR*) tData;
+
+		if (dbHdr->type != MTF_ESET)
+		{
+			fprintf(stderr, "Data set #%u has no ESET block!\n", num);
+			return(-1);
+		}
+
+		eset = (MTF_ESET_BLK*) dbHdr;
+
+		if (checkBlock() != 0)
+			return(-1);
+
+		end = ((unsigned long long) dbHdr->fla.most << 32) +
+		      (unsigned long long) dbHdr->fla.least;
+
+		printSet(num, ptr, attr, date, (end - start) * flbSize);
+
+		if (spaceTape(MTFSF, 1) != 0)
+		{
+			fprintf(stderr, "Error spacing to next data set!\n");
+			return(-1);
+		}
+
+		result = readNextBlock(0);
+		if (result < 0)
+			return(-1);
+
+		dbHdr = (MTF_DB_HDR*) tData;
+	}
+
+	return(0);
+}
+
+
+/* findLastEset() positions the tape at the last ESET block on it, found by  */
+/* spacing back over filemarks from the end of recorded data. If an EOTM     */
+/* block is found there instead, it gives the address of the last ESET.      */
+
+static INT32 findLastEset(void)
+{
+	int back;
+
+	for (back = 2; back <= 3; back += 1)
+	{
+		if ((spaceTape(MTEOM, 1) != 0) || (spaceTape(MTBSF, back) != 0) ||
+		    (spaceTape(MTFSF, 1) != 0))
+			return(1);
+
+		if (readNextBlock(0) != 0)
+			continue;
+
+		dbHdr = (MTF_DB_HDR*) tData;
+
+		if (dbHdr->type == MTF_EOTM)
+		{
+			eotm = (MTF_EOTM_BLK*) dbHdr;
+
+			if ((checkBlock() != 0) ||
+			    ((dbHdr->attr & (MTF_NO_ESET_PBA | MTF_INVALID_ESET_PBA)) != 0))
+				return(1);
+
+			if ((seekTape(&eotm->lastEset) != 0) || (readAfterSeek() != 0))
+				return(1);
+
+			dbHdr = (MTF_DB_HDR*) tData;
+		}
+
+		if (dbHdr->type == MTF_ESET)
+		{
+			eset = (MTF_ESET_BLK*) dbHdr;
+
+			if (checkBlock() != 0)
+				return(1);
+
+			if (verbose > 0) fprintf(stdout, "Found last ESET block.\n");
+
+			return(0);
+		}
+	}
+
+	return(1);
+}
+
+
+/* readSetMap() returns the data of the set map stream of the ESET block at   */
+/* tData, or NULL if it has none.                                             */
+
+static UINT8 *readSetMap(UINT32 *length)
+{
+	INT32 offset;
+
+	if (dbHdr->off >= flbSize)
+		return(NULL);
+
+	stream = (MTF_STREAM_HDR*) ((char*) dbHdr + dbHdr->off);
+
+	while ((filemark == 0) && (stream->id != MTF_SPAD))
+	{
+		if ((stream->id == MTF_TSMP) || (stream->id == MTF_MAP2))
+			return(readStream(length, &offset));
+
+		offset = skipOverStream();
+		if (offset < 0)
+			return(NULL);
+
+		stream = (MTF_STREAM_HDR*) &tData[offset];
+	}
+
+	return(NULL);
+}
+
+
+/* rewindSets() rewinds the tape and reads the first block of the first data  */
+/* set, as openMedia() leaves it.                                             */
+
+static INT32 rewindSets(void)
+{
+	if (verbose > 0) fprintf(stdout, "Rewinding to first data set...\n");
+
+	if ((spaceTape(MTREW, 1) != 0) || (spaceTape(MTFSF, 1) != 0))
+	{
+		fprintf(stderr, "Error rewinding tape!\n");
+		return(-1);
+	}
+
+	if (readNextBlock(0) != 0)
+	{
+		fprintf(stderr, "Error reading first block of data set!\n");
+		return(-1);
+	}
+
+	return(1);
+}
+
+
+static INT32 spaceTape(int operation, int count)
+{
+	struct mtop op;
+
+	op.mt_op = operation;
+	op.mt_count = count;
+
+	filemark = 0;
+	remaining = 0;
+
+	return(positionTape(&op));
+}
+
+
+/* readAfterSeek() reads the block the tape was sought to. A seek to the      */
+/* first block after a filemark may stop before the filemark.                 */
+
+static INT32 readAfterSeek(void)
+{
+	INT32 result;
+
+	filemark = 0;
+	remaining = 0;
+
+	result = readNextBlock(0);
+	if (result == 1)
+	{
+		filemark = 0;
+		result = readNextBlock(0);
+	}
+
+	return((result == 0) ? 0 : -1);
+}
+
+
+/* printSet() prints one line of the data set list.                         */
+
+void printSet(UINT16 num, char *name, UINT32 attr, UINT8 *date,
+              unsigned long long size)
+{
+	char *type;
+
+	if (attr & MTF_SSET_TRANSFER_BIT)
+		type = "transfer";
+	else if (attr & MTF_SSET_COPY_BIT)
+		type = "copy";
+	else if (attr & MTF_SSET_DIFFERENTIAL_BIT)
+		type = "differential";
+	else if (attr & MTF_SSET_INCREMENTAL_BIT)
+		type = "incremental";
+	else if (attr & MTF_SSET_DAILY_BIT)
+		type = "daily";
+	else
+		type = "normal";
+
+	fprintf(stdout, "%5u  %02u/%02u/%04u %02u:%02u:%02u  %-12s %14llu  %s\n",
+	        num, MTF_MONTH(date), MTF_DAY(date), MTF_YEAR(date),
+	        MTF_HOUR(date), MTF_MINUTE(date), MTF_SECOND(date), type, size,
+	        name);
+
+	return;
+}
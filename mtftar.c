@@ -0,0 +1,441 @@
+/*
+
+mtf - a Microsoft Tape Format reader (and future writer?)
+Copyright (C) 1999  D. Alan Stewart, Layton Graphics, Inc.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+Contact the author at:
+
+D. Alan Stewart
+Layton Graphics, Inc.
+155 Woolco Dr.
+Marietta, GA 30062, USA
+astewart@layton-graphics.com
+
+See mtf.c for version history, contributors, etc.
+
+**
+**	mtftar.c
+**
+**	functions for writing the files read from tape to a pax archive instead
+**	of to the filesystem
+**
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <utime.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include "mtf.h"
+
+
+extern UINT8 verbose, debug;
+extern uid_t owner;
+extern gid_t group;
+
+
+typedef struct
+{
+	char	name[100];
+	char	mode[8];
+	char	uid[8];
+	char	gid[8];
+	char	size[12];
+	char	mtime[12];
+	char	chksum[8];
+	char	typeflag;
+	char	linkname[100];
+	char	magic[6];
+	char	version[2];
+	char	uname[32];
+	char	gname[32];
+	char	devmajor[8];
+	char	devminor[8];
+	char	prefix[155];
+	char	pad[12];
+} TAR_HEADER;
+
+
+UINT8 archiving = 0;
+
+static int archive = -1;
+static UINT8 *arcBuffer = NULL;
+static size_t arcUsed = 0;
+static unsigned long long arcTotal = 0;
+static char arcPath[MAXPATHLEN + 1];
+static struct utimbuf arcTimes;
+static UINT8 arcHeader, arcSkip;
+static unsigned long long arcSize, arcWritten;
+
+
+static INT32 putHeader(char*, char, unsigned long long, struct utimbuf*);
+static INT32 putArchive(UINT8*, size_t);
+static INT32 padArchive(size_t);
+static INT32 flushArchive(void);
+static void addRecord(char*, size_t*, char*, char*);
+
+
+/* openArchive() opens the archive that files are written to. An archive     */
+/* named - is written to standard output, and anything that would have been   */
+/* printed there goes to standard error instead.                              */
+
+INT32 openArchive(char *path)
+{
+	arcBuffer = (UINT8*) malloc(ARCHIVE_BUFFER_SIZE);
+	if (arcBuffer == NULL)
+	{
+		fprintf(stderr, "Memory error while opening archive!\n");
+		return(-1);
+	}
+
+	if (strcmp(path, "-") == 0)
+	{
+		fflush(stdout);
+
+		archive = dup(STDOUT_FILENO);
+		if ((archive == -1) || (dup2(STDERR_FILENO, STDOUT_FILENO) == -1))
+		{
+			fprintf(stderr, "Error %d redirecting standard output!\n", errno);
+			return(-1);
+		}
+	}
+	else
+	{
+		archive = open(path, O_WRONLY | O_TRUNC | O_CREAT,
+		               S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+		if (archive == -1)
+		{
+			fprintf(stderr, "Error %d opening/creating %s for writing!\n",
+			        errno, path);
+			return(-1);
+		}
+	}
+
+	arcUsed = 0;
+	arcTotal = 0;
+	archiving = 1;
+
+	return(0);
+}
+
+
+/* closeArchive() ends the archive with two zero blocks, pads it to a whole   */
+/* number of records and closes it.                                           */
+
+INT32 closeArchive(void)
+{
+	INT32 result;
+	size_t pad;
+
+	if (archive == -1)
+		return(0);
+
+	result = padArchive(2 * TAR_BLOCK_SIZE);
+
+	pad = (size_t) ((TAR_RECORD_SIZE - (arcTotal % TAR_RECORD_SIZE)) %
+	                TAR_RECORD_SIZE);
+	if ((result == 0) && (pad > 0))
+		result = padArchive(pad);
+
+	if ((result == 0) && (flushArchive() != 0))
+		result = -1;
+
+	if ((close(archive) != 0) && (result == 0))
+	{
+		fprintf(stderr, "Error %d closing archive!\n", errno);
+		result = -1;
+	}
+
+	archive = -1;
+	archiving = 0;
+	free(arcBuffer);
+	arcBuffer = NULL;
+
+	return(result);
+}
+
+
+/* archiveDirectory() adds an entry for a directory to the archive.           */
+
+INT32 archiveDirectory(char *path, struct utimbuf *times)
+{
+	while (*path == '/')
+		path += 1;
+
+	if (*path == '\0')
+		return(0);
+
+	return(putHeader(path, '5', 0, times));
+}
+
+
+/* beginArchiveFile() starts a file in the archive. Its header is written by  */
+/* archiveSize() once the length of its data is known, or by                  */
+/* finishArchiveFile() if it has none.                                        */
+
+INT32 beginArchiveFile(char *path, struct utimbuf *times)
+{
+	while (*path == '/')
+		path += 1;
+
+	strcpy(arcPath, path);
+	arcTimes = *times;
+	arcHeader = 0;
+	arcSkip = 0;
+	arcSize = 0;
+	arcWritten = 0;
+
+	return(0);
+}
+
+
+/* archiveSize() writes the header of the file being archived, now that the   */
+/* length of its data is known.                                               */
+
+INT32 archiveSize(UINT64 *length)
+{
+	if (arcSkip != 0)
+		return(0);
+
+	if (arcHeader != 0)
+	{
+		fprintf(stderr, "%s has more than one data stream!\n", arcPath);
+		return(-1);
+	}
+
+	arcSize = ((unsigned long long) length->most << 32) +
+	          (unsigned long long) length->least;
+	arcHeader = 1;
+
+	return(putHeader(arcPath, '0', arcSize, &arcTimes));
+}
+
+
+/* archiveWrite() adds data of the file being archived.                       */
+
+INT32 archiveWrite(UINT8 *data, size_t bytes)
+{
+	if (arcSkip != 0)
+		return(0);
+
+	if (arcWritten + bytes > arcSize)
+	{
+		fprintf(stderr, "Too much data for %s!\n", arcPath);
+		return(-1);
+	}
+
+	arcWritten += bytes;
+
+	return(putArchive(data, bytes));
+}
+
+
+/* skipArchiveFile() leaves the file being archived out of the archive, for */
+/* data that cannot be archived such as the regions of a sparse file.        */
+
+void skipArchiveFile(char *why)
+{
+	if (arcSkip == 0)
+		fprintf(stderr, "%s %s... skipping!\n", arcPath, why);
+
+	arcSkip = 1;
+
+	return;
+}
+
+
+/* finishArchiveFile() pads the data of the file being archived to a whole    */
+/* block.                                                                     */
+
+INT32 finishArchiveFile(void)
+{
+	/* a skipped file whose header is already out is filled with zeros */
+	if ((arcSkip != 0) && (arcHeader == 0))
+		return(0);
+
+	if ((arcSkip != 0) && (padArchive((size_t) (arcSize - arcWritten)) != 0))
+		return(-1);
+
+	if (arcSkip != 0)
+		arcWritten = arcSize;
+
+	if ((arcHeader == 0) && (putHeader(arcPath, '0', 0, &arcTimes) != 0))
+		return(-1);
+
+	if (arcWritten != arcSize)
+	{
+		fprintf(stderr, "Only %llu of %llu bytes of %s were read!\n",
+		        arcWritten, arcSize, arcPath);
+		return(-1);
+	}
+
+	return(padArchive((size_t) ((TAR_BLOCK_SIZE - (arcSize % TAR_BLOCK_SIZE)) %
+	                            TAR_BLOCK_SIZE)));
+}
+
+
+/* putHeader() writes a ustar header, preceded by a pax extended header       */
+/* carrying the access time and anything else that does not fit in it.       */
+
+static INT32 putHeader(char *path, char type, unsigned long long size,
+                       struct utimbuf *times)
+{
+	TAR_HEADER hdr;
+	char records[MAXPATHLEN + 256], value[32];
+	size_t used, i;
+	UINT32 sum;
+	UINT8 *ptr;
+
+	if (debug > 0) printf("archiving %s (%llu bytes)\n", path, size);
+
+	used = 0;
+
+	sprintf(value, "%ld", (long) times->actime);
+	addRecord(records, &used, "atime", value);
+
+	if (strlen(path) >= sizeof(hdr.name))
+		addRecord(records, &used, "path", path);
+
+	if (size > 077777777777ULL)
+	{
+		sprintf(value, "%llu", size);
+		addRecord(records, &used, "size", value);
+	}
+
+	if (type != 'x')
+	{
+		if (putHeader("PaxHeader", 'x', (unsigned long long) used, times) != 0)
+			return(-1);
+
+		if (putArchive((UINT8*) records, used) != 0)
+			return(-1);
+
+		if (padArchive((TAR_BLOCK_SIZE - (used % TAR_BLOCK_SIZE)) %
+		               TAR_BLOCK_SIZE) != 0)
+			return(-1);
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+
+	memcpy(hdr.name, path, min(strlen(path), sizeof(hdr.name)));
+	sprintf(hdr.mode, "%07o", (type == '5') ? 0755 : 0644);
+	sprintf(hdr.uid, "%07o", (owner != (uid_t) -1) ? (unsigned) owner & 07777777 : 0);
+	sprintf(hdr.gid, "%07o", (group != (gid_t) -1) ? (unsigned) group & 07777777 : 0);
+	sprintf(hdr.size, "%011llo", (size > 077777777777ULL) ? 0 : size);
+	sprintf(hdr.mtime, "%011lo", (unsigned long) times->modtime & 077777777777UL);
+	hdr.typeflag = type;
+	memcpy(hdr.magic, "ustar", 6);
+	memcpy(hdr.version, "00", 2);
+	memset(hdr.chksum, ' ', sizeof(hdr.chksum));
+
+	sum = 0;
+	ptr = (UINT8*) &hdr;
+	for (i = 0; i < sizeof(hdr); i += 1)
+		sum += ptr[i];
+
+	sprintf(hdr.chksum, "%06lo", (unsigned long) sum);
+	hdr.chksum[7] = ' ';
+
+	return(putArchive((UINT8*) &hdr, sizeof(hdr)));
+}
+
+
+/* addRecord() appends a pax extended header record. Its length field counts  */
+/* itself, so the length is found by trying each possible number of digits.   */
+
+static void addRecord(char *records, size_t *used, char *key, char *value)
+{
+	size_t length, digits;
+	char count[16];
+
+	length = strlen(key) + strlen(value) + 3;
+
+	for (digits = 1; digits < 10; digits += 1)
+	{
+		sprintf(count, "%lu", (unsigned long) (length + digits));
+		if (strlen(count) == digits)
+			break;
+	}
+
+	sprintf(&records[*used], "%lu %s=%s\n", (unsigned long) (length + digits),
+	        key, value);
+
+	*used += length + digits;
+
+	return;
+}
+
+
+static INT32 putArchive(UINT8 *data, size_t bytes)
+{
+	size_t chunk;
+
+	while (bytes > 0)
+	{
+		if ((arcUsed == ARCHIVE_BUFFER_SIZE) && (flushArchive() != 0))
+			return(-1);
+
+		chunk = min(bytes, ARCHIVE_BUFFER_SIZE - arcUsed);
+		memcpy(&arcBuffer[arcUsed], data, chunk);
+		arcUsed += chunk;
+		arcTotal += chunk;
+		data += chunk;
+		bytes -= chunk;
+	}
+
+	return(0);
+}
+
+
+static INT32 padArchive(size_t bytes)
+{
+	size_t chunk;
+
+	while (bytes > 0)
+	{
+		if ((arcUsed == ARCHIVE_BUFFER_SIZE) && (flushArchive() != 0))
+			return(-1);
+
+		chunk = min(bytes, ARCHIVE_BUFFER_SIZE - arcUsed);
+		memset(&arcBuffer[arcUsed], 0, chunk);
+		arcUsed += chunk;
+		arcTotal += chunk;
+		bytes -= chunk;
+	}
+
+	return(0);
+}
+
+
+static INT32 flushArchive(void)
+{
+	if (writeAll(archive, arcBuffer, arcUsed) != 0)
+	{
+		fprintf(stderr, "Error %d writing archive!\n", errno);
+		return(-1);
+	}
+
+	arcUsed = 0;
+
+	return(0);
+}
@@ -0,0 +1,972 @@
+/*
+
+mtf - a Microsoft Tape Format reader (and future writer?)
+Copyright (C) 1999  D. Alan Stewart, Layton Graphics, Inc.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+Contact the author at:
+
+D. Alan Stewart
+Layton Graphics, Inc.
+155 Woolco Dr.
+Marietta, GA 30062, USA
+astewart@layton-graphics.com
+
+See mtf.c for version history, contributors, etc.
+
+**
+**	mtfuring.c
+**
+**	asynchronous tape reads and file writes through Linux io_uring; built
+**	only when USE_IO_URING is defined, otherwise -A reports that it is not
+**	available and the ordinary read()/write() code is used
+**
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <utime.h>
+#include "mtf.h"
+
+
+extern UINT8 asyncIO;
+
+UINT8 asyncReads = 0;
+UINT32 asyncErrors = 0;
+
+
+#ifdef USE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+
+extern int mtfd;
+extern UINT8 verbose, debug;
+
+
+#define ASYNC_READ 1
+#define ASYNC_WRITE 2
+#define ASYNC_CLOSE 3
+
+typedef struct
+{
+	UINT8	type;		/* ASYNC_READ */
+	UINT8	done;		/* non-zero once the read has completed */
+	ssize_t	length;		/* bytes read, 0 for a filemark, -errno for an error */
+	size_t	pos;		/* bytes already handed out */
+	UINT8	*data;		/* tape blocks */
+} READ_SLOT;
+
+typedef struct ASYNC_FILE
+{
+	UINT8				type;		/* ASYNC_CLOSE */
+	int					fd;			/* file being written */
+	UINT32				pending;	/* writes submitted but not completed */
+	UINT8				closing;	/* close once pending reaches zero */
+	off_t				offset;		/* file offset of the next byte */
+	struct OUT_BUFFER	*buffer;	/* buffer being filled */
+	struct timespec		times[2];	/* access and modification times */
+	char				*path;		/* for error messages */
+} ASYNC_FILE;
+
+typedef struct OUT_BUFFER
+{
+	UINT8				type;		/* ASYNC_WRITE */
+	ASYNC_FILE			*file;		/* file written to */
+	size_t				length;		/* bytes in buffer */
+	off_t				offset;		/* file offset of first byte */
+	UINT8				*data;		/* ASYNC_BUFFER_SIZE bytes */
+	struct OUT_BUFFER	*next;		/* free list */
+} OUT_BUFFER;
+
+
+static int ringFd = -1;
+static struct io_uring_params params;
+static UINT8 *sqRing, *cqRing;
+static size_t sqRingSize, cqRingSize;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cqes;
+static unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+static unsigned *cqHead, *cqTail, *cqMask;
+static unsigned sqeTail, sqeSubmitted, inFlight;
+
+static READ_SLOT *reads = NULL;
+static UINT8 *readData = NULL;
+static UINT16 readSlots, readNext, readHalf;
+static UINT8 readEntered, readMarks, readStop;
+static ssize_t readEnd;
+static size_t readLength;
+
+static OUT_BUFFER *buffers = NULL, *freeBuffers = NULL;
+static UINT8 *bufferData = NULL;
+static ASYNC_FILE *current = NULL;
+
+
+static INT32 reserveSqes(unsigned);
+static struct io_uring_sqe *getSqe(void);
+static INT32 submitAsync(UINT32);
+static INT32 reapAsync(UINT32);
+static void completeAsync(struct io_uring_cqe*);
+static void submitReads(UINT16, UINT16);
+static INT32 waitReads(UINT16, UINT16);
+static void nextRead(void);
+static ASYNC_FILE *getFile(int);
+static OUT_BUFFER *getBuffer(void);
+static INT32 submitWrite(ASYNC_FILE*);
+static void finishFile(ASYNC_FILE*);
+
+
+/* startAsync() sets up the io_uring submission and completion rings and the  */
+/* pool of output buffers.                                                    */
+
+INT32 startAsync(void)
+{
+	UINT16 i;
+
+	memset(&params, 0, sizeof(params));
+
+	ringFd = (int) syscall(__NR_io_uring_setup, ASYNC_ENTRIES, &params);
+	if (ringFd < 0)
+	{
+		fprintf(stderr, "Error %d setting up io_uring!\n", errno);
+		return(-1);
+	}
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes +
+	             params.cq_entries * sizeof(struct io_uring_cqe);
+
+	if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+	{
+		sqRingSize = max(sqRingSize, cqRingSize);
+		cqRingSize = sqRingSize;
+	}
+
+	sqRing = (UINT8*) mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE,
+	                       MAP_SHARED | MAP_POPULATE, ringFd,
+	                       IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED)
+	{
+		fprintf(stderr, "Error %d mapping io_uring!\n", errno);
+		close(ringFd);
+		ringFd = -1;
+		return(-1);
+	}
+
+	if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+	{
+		cqRing = sqRing;
+	}
+	else
+	{
+		cqRing = (UINT8*) mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE,
+		                       MAP_SHARED | MAP_POPULATE, ringFd,
+		                       IORING_OFF_CQ_RING);
+		if (cqRing == MAP_FAILED)
+		{
+			fprintf(stderr, "Error %d mapping io_uring!\n", errno);
+			munmap(sqRing, sqRingSize);
+			close(ringFd);
+			ringFd = -1;
+			return(-1);
+		}
+	}
+
+	sqes = (struct io_uring_sqe*) mmap(NULL, params.sq_entries *
+	                                   sizeof(struct io_uring_sqe),
+	                                   PROT_READ | PROT_WRITE,
+	                                   MAP_SHARED | MAP_POPULATE, ringFd,
+	                                   IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+	{
+		fprintf(stderr, "Error %d mapping io_uring!\n", errno);
+		if (cqRing != sqRing) munmap(cqRing, cqRingSize);
+		munmap(sqRing, sqRingSize);
+		close(ringFd);
+		ringFd = -1;
+		return(-1);
+	}
+
+	sqHead = (unsigned*) (sqRing + params.sq_off.head);
+	sqTail = (unsigned*) (sqRing + params.sq_off.tail);
+	sqMask = (unsigned*) (sqRing + params.sq_off.ring_mask);
+	sqArray = (unsigned*) (sqRing + params.sq_off.array);
+	cqHead = (unsigned*) (cqRing + params.cq_off.head);
+	cqTail = (unsigned*) (cqRing + params.cq_off.tail);
+	cqMask = (unsigned*) (cqRing + params.cq_off.ring_mask);
+	cqes = (struct io_uring_cqe*) (cqRing + params.cq_off.cqes);
+
+	sqeTail = *sqTail;
+	sqeSubmitted = sqeTail;
+	inFlight = 0;
+
+	buffers = (OUT_BUFFER*) malloc(sizeof(OUT_BUFFER) * ASYNC_BUFFERS);
+	bufferData = (UINT8*) malloc((size_t) ASYNC_BUFFER_SIZE * ASYNC_BUFFERS);
+	if ((buffers == NULL) || (bufferData == NULL))
+	{
+		fprintf(stderr, "Unable to allocate output buffers!\n");
+		stopAsync();
+		return(-1);
+	}
+
+	freeBuffers = NULL;
+	for (i = 0; i < ASYNC_BUFFERS; i += 1)
+	{
+		buffers[i].type = ASYNC_WRITE;
+		buffers[i].data = &bufferData[(size_t) ASYNC_BUFFER_SIZE * i];
+		buffers[i].next = freeBuffers;
+		freeBuffers = &buffers[i];
+	}
+
+	asyncErrors = 0;
+
+	if (verbose > 1)
+		fprintf(stdout, "Using io_uring for tape reads and file writes.\n");
+
+	return(0);
+}
+
+
+/* stopAsync() waits for all outstanding reads, writes and closes and tears   */
+/* the rings down. It returns -1 if any asynchronous operation failed.        */
+
+INT32 stopAsync(void)
+{
+	if (ringFd < 0)
+		return((asyncErrors == 0) ? 0 : -1);
+
+	if ((current != NULL) && (current->buffer != NULL))
+		submitWrite(current);
+
+	current = NULL;
+
+	while (inFlight > 0)
+	{
+		if (reapAsync(1) != 0)
+			break;
+	}
+
+	munmap(sqes, params.sq_entries * sizeof(struct io_uring_sqe));
+	if (cqRing != sqRing) munmap(cqRing, cqRingSize);
+	munmap(sqRing, sqRingSize);
+	close(ringFd);
+	ringFd = -1;
+
+	free(reads);
+	free(readData);
+	free(buffers);
+	free(bufferData);
+	reads = NULL;
+	readData = NULL;
+	buffers = NULL;
+	bufferData = NULL;
+	freeBuffers = NULL;
+	asyncReads = 0;
+
+	return((asyncErrors == 0) ? 0 : -1);
+}
+
+
+/* startAsyncReads() starts reading the tape ahead through io_uring instead   */
+/* of with a reader thread. The slots are split into two halves; each half is */
+/* submitted as one linked chain so its reads run in tape order, and a half   */
+/* is only submitted once the other one has completed. One half is therefore  */
+/* always being read while the blocks of the other are used. As with the      */
+/* reader thread, nothing more is read after the end of recorded data (two    */
+/* filemarks in a row) or a read error.                                       */
+
+INT32 startAsyncReads(size_t length, UINT16 slots)
+{
+	UINT16 i;
+
+	slots = min(max(slots, 2), params.sq_entries / 2);
+	slots += slots % 2;
+
+	reads = (READ_SLOT*) malloc(sizeof(READ_SLOT) * slots);
+	readData = (UINT8*) malloc(length * slots);
+	if ((reads == NULL) || (readData == NULL))
+	{
+		fprintf(stderr, "Unable to allocate read-ahead buffers!\n");
+		free(reads);
+		free(readData);
+		reads = NULL;
+		readData = NULL;
+		return(-1);
+	}
+
+	for (i = 0; i < slots; i += 1)
+	{
+		reads[i].type = ASYNC_READ;
+		reads[i].done = 1;
+		reads[i].length = 0;
+		reads[i].data = &readData[length * i];
+	}
+
+	readSlots = slots;
+	readLength = length;
+	readNext = 0;
+	readHalf = slots / 2;
+	readEntered = 0;
+	readMarks = 0;
+	readStop = 0;
+	asyncReads = 1;
+
+	submitReads(0, readHalf);
+
+	return(0);
+}
+
+
+/* readAsync() returns the next tape block read through io_uring, with the   */
+/* same results as read().                                                    */
+
+ssize_t readAsync(UINT8 *buffer, size_t size)
+{
+	READ_SLOT *slot;
+	ssize_t result;
+	UINT16 start, end;
+
+	if ((readEntered == 0) && (readStop != 0))
+	{
+		/* the reads have stopped; repeat whatever stopped them */
+		if (readEnd < 0)
+		{
+			errno = (int) -readEnd;
+			return(-1);
+		}
+
+		return(0);
+	}
+
+	if (readEntered == 0)
+	{
+		/* entering a half: wait for all of it, then read the other one */
+		start = readNext;
+		end = readNext + readHalf;
+
+		if (waitReads(start, end) != 0)
+			return(-1);
+
+		if (readStop == 0)
+			submitReads((end == readSlots) ? 0 : end, readHalf);
+
+		readEntered = 1;
+	}
+
+	slot = &reads[readNext];
+
+	if (slot->length < 0)
+	{
+		errno = (int) -slot->length;
+		nextRead();
+		return(-1);
+	}
+
+	result = (ssize_t) min((size_t) slot->length - slot->pos, size);
+	memcpy(buffer, &slot->data[slot->pos], result);
+	slot->pos += result;
+
+	if ((result == 0) || (slot->pos == (size_t) slot->length))
+		nextRead();
+
+	return(result);
+}
+
+
+/* nextRead() moves on to the next read slot. A slot may hold many tape      */
+/* blocks, so the other half is only submitted when a half is first entered. */
+
+static void nextRead(void)
+{
+	readNext = (readNext + 1) % readSlots;
+
+	if ((readNext % readHalf) == 0)
+		readEntered = 0;
+
+	return;
+}
+
+
+/* stopAsyncReads() stops reading the tape ahead, waiting for the reads that  */
+/* were submitted. Any tape blocks read ahead but not used are discarded.     */
+
+void stopAsyncReads(void)
+{
+	UINT16 i;
+
+	if (asyncReads == 0)
+		return;
+
+	for (i = 0; i < readSlots; i += 1)
+	{
+		while (reads[i].done == 0)
+		{
+			if (reapAsync(1) != 0)
+				break;
+		}
+	}
+
+	free(reads);
+	free(readData);
+	reads = NULL;
+	readData = NULL;
+	asyncReads = 0;
+
+	return;
+}
+
+
+/* asyncWrite() copies data into the output buffer of the file being written  */
+/* and submits the buffer once it is full.                                    */
+
+INT32 asyncWrite(int fd, UINT8 *data, size_t length)
+{
+	ASYNC_FILE *file;
+	OUT_BUFFER *buffer;
+	size_t bytes;
+
+	if (asyncErrors != 0)
+		return(-1);
+
+	file = getFile(fd);
+	if (file == NULL)
+		return(-1);
+
+	while (length > 0)
+	{
+		if (file->buffer == NULL)
+		{
+			buffer = getBuffer();
+			if (buffer == NULL)
+				return(-1);
+
+			buffer->file = file;
+			buffer->length = 0;
+			buffer->offset = file->offset;
+			file->buffer = buffer;
+		}
+
+		buffer = file->buffer;
+
+		bytes = min(length, ASYNC_BUFFER_SIZE - buffer->length);
+		memcpy(&buffer->data[buffer->length], data, bytes);
+		buffer->length += bytes;
+		file->offset += bytes;
+		data += bytes;
+		length -= bytes;
+
+		if (buffer->length == ASYNC_BUFFER_SIZE)
+		{
+			if (submitWrite(file) != 0)
+				return(-1);
+		}
+	}
+
+	return(0);
+}
+
+
+/* asyncSeek() moves the file offset at which the next data for a file is    */
+/* written, leaving a hole between the regions of a sparse file.              */
+
+INT32 asyncSeek(int fd, off_t offset)
+{
+	ASYNC_FILE *file;
+
+	if (asyncErrors != 0)
+		return(-1);
+
+	file = getFile(fd);
+	if (file == NULL)
+		return(-1);
+
+	if ((file->buffer != NULL) && (submitWrite(file) != 0))
+		return(-1);
+
+	file->offset = offset;
+
+	return(0);
+}
+
+
+/* asyncClose() submits what is left of the file's data. Once all of its     */
+/* writes have completed the access and modification times are set and the    */
+/* file is closed, without waiting here for any of it.                        */
+
+INT32 asyncClose(int fd, char *path, struct utimbuf *times)
+{
+	ASYNC_FILE *file;
+
+	file = getFile(fd);
+	if (file == NULL)
+		return(-1);
+
+	if (file->buffer != NULL)
+	{
+		if (submitWrite(file) != 0)
+			return(-1);
+	}
+
+	file->path = strdup(path);
+	file->times[0].tv_sec = times->actime;
+	file->times[0].tv_nsec = 0;
+	file->times[1].tv_sec = times->modtime;
+	file->times[1].tv_nsec = 0;
+	file->closing = 1;
+	current = NULL;
+
+	if (file->pending == 0)
+		finishFile(file);
+
+	submitAsync(0);
+
+	return((asyncErrors == 0) ? 0 : -1);
+}
+
+
+/* reserveSqes() makes room for count submission queue entries, submitting    */
+/* queued entries first if the queue is too full and reaping completions if   */
+/* too many operations would be outstanding for the completion queue to hold. */
+
+static INT32 reserveSqes(unsigned count)
+{
+	while (inFlight + (sqeTail - sqeSubmitted) + count > params.cq_entries)
+	{
+		if (reapAsync(1) != 0)
+			return(-1);
+	}
+
+	if (sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) + count >
+	    params.sq_entries)
+		submitAsync(0);
+
+	return(0);
+}
+
+
+/* getSqe() returns the next free submission queue entry.                     */
+
+static struct io_uring_sqe *getSqe(void)
+{
+	struct io_uring_sqe *sqe;
+	unsigned index;
+
+	if (reserveSqes(1) != 0)
+		return(NULL);
+
+	index = sqeTail & *sqMask;
+	sqe = &sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqArray[index] = index;
+	sqeTail += 1;
+
+	return(sqe);
+}
+
+
+/* submitAsync() hands queued entries to the kernel and, if asked to, waits   */
+/* for at least that many completions.                                        */
+
+static INT32 submitAsync(UINT32 wait)
+{
+	unsigned count;
+	int result;
+
+	count = sqeTail - sqeSubmitted;
+	__atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+
+	if ((count == 0) && (wait == 0))
+		return(0);
+
+	do
+	{
+		result = (int) syscall(__NR_io_uring_enter, ringFd, count, wait,
+		                       (wait > 0) ? IORING_ENTER_GETEVENTS : 0,
+		                       NULL, 0);
+	} while ((result < 0) && (errno == EINTR));
+
+	if (result < 0)
+	{
+		fprintf(stderr, "Error %d submitting to io_uring!\n", errno);
+		asyncErrors += 1;
+		return(-1);
+	}
+
+	sqeSubmitted += (unsigned) result;
+	inFlight += (unsigned) result;
+
+	return(0);
+}
+
+
+/* reapAsync() processes all available completions. If wait is non-zero and  */
+/* there are none it first waits for one.                                     */
+
+static INT32 reapAsync(UINT32 wait)
+{
+	struct io_uring_cqe cqe;
+	unsigned head;
+
+	head = *cqHead;
+
+	if ((wait != 0) && (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)))
+	{
+		if (submitAsync(1) != 0)
+			return(-1);
+	}
+
+	while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+	{
+		cqe = cqes[head & *cqMask];
+		head += 1;
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+		inFlight -= 1;
+
+		completeAsync(&cqe);
+
+		head = *cqHead;
+	}
+
+	return(0);
+}
+
+
+/* completeAsync() finishes one operation.                                    */
+
+static void completeAsync(struct io_uring_cqe *cqe)
+{
+	READ_SLOT *slot;
+	OUT_BUFFER *buffer;
+	ASYNC_FILE *file;
+
+	switch (*((UINT8*) (unsigned long) cqe->user_data))
+	{
+		case ASYNC_READ:
+			slot = (READ_SLOT*) (unsigned long) cqe->user_data;
+			slot->length = cqe->res;
+			slot->pos = 0;
+			slot->done = 1;
+
+			if ((debug > 0) && (cqe->res <= 0))
+				printf("io_uring read returned %d\n", cqe->res);
+			break;
+
+		case ASYNC_WRITE:
+			buffer = (OUT_BUFFER*) (unsigned long) cqe->user_data;
+			file = buffer->file;
+
+			if (cqe->res != (int) buffer->length)
+			{
+				if (cqe->res < 0)
+					fprintf(stderr, "Error %d writing %s!\n", -cqe->res,
+					        (file->path != NULL) ? file->path : "file");
+				else
+					fprintf(stderr, "Error writing %s!\n",
+					        (file->path != NULL) ? file->path : "file");
+				asyncErrors += 1;
+			}
+
+			buffer->next = freeBuffers;
+			freeBuffers = buffer;
+
+			file->pending -= 1;
+			if ((file->closing != 0) && (file->pending == 0))
+				finishFile(file);
+			break;
+
+		case ASYNC_CLOSE:
+			file = (ASYNC_FILE*) (unsigned long) cqe->user_data;
+
+			if (cqe->res < 0)
+			{
+				fprintf(stderr, "Error %d closing %s!\n", -cqe->res,
+				        file->path);
+				asyncErrors += 1;
+			}
+
+			free(file->path);
+			free(file);
+			break;
+	}
+
+	return;
+}
+
+
+/* submitReads() submits count reads, starting at slot first, as one linked  */
+/* chain. A read that comes up short (a filemark or an error) breaks the      */
+/* chain and the reads after it complete with -ECANCELED; waitReads() reads   */
+/* those again. Room is made for the whole chain first, so that none of it is */
+/* submitted before its last entry is queued.                                 */
+
+static void submitReads(UINT16 first, UINT16 count)
+{
+	struct io_uring_sqe *sqe;
+	UINT16 i;
+
+	if (reserveSqes(count) != 0)
+	{
+		for (i = first; i < first + count; i += 1)
+		{
+			reads[i].length = -EIO;
+			reads[i].done = 1;
+		}
+
+		return;
+	}
+
+	for (i = first; i < first + count; i += 1)
+	{
+		reads[i].done = 0;
+		reads[i].pos = 0;
+
+		sqe = getSqe();
+		if (sqe == NULL)
+		{
+			reads[i].length = -EIO;
+			reads[i].done = 1;
+			continue;
+		}
+
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = mtfd;
+		sqe->addr = (unsigned long) reads[i].data;
+		sqe->len = (unsigned) readLength;
+		sqe->off = (__u64) -1;
+		sqe->user_data = (unsigned long) &reads[i];
+
+		if (i + 1 < first + count)
+			sqe->flags = IOSQE_IO_LINK;
+	}
+
+	submitAsync(0);
+
+	return;
+}
+
+
+/* waitReads() waits until the reads in slots start to end - 1 have all      */
+/* completed, reading again any that were cancelled by a broken chain. Once   */
+/* a read error or a second filemark in a row is met the reads are stopped;   */
+/* the slots after it are given the same result instead of being read again.  */
+
+static INT32 waitReads(UINT16 start, UINT16 end)
+{
+	UINT16 i;
+
+	for (i = start; i < end; i += 1)
+	{
+		while (reads[i].done == 0)
+		{
+			if (reapAsync(1) != 0)
+				return(-1);
+		}
+
+		if (readStop != 0)
+		{
+			reads[i].length = readEnd;
+			continue;
+		}
+
+		if (reads[i].length == -ECANCELED)
+		{
+			submitReads(i, end - i);
+			i -= 1;
+			continue;
+		}
+
+		if (reads[i].length == 0)
+			readMarks += 1;
+		else
+			readMarks = 0;
+
+		if ((reads[i].length < 0) || (readMarks > 1))
+		{
+			readStop = 1;
+			readEnd = reads[i].length;
+		}
+	}
+
+	return(0);
+}
+
+
+/* getFile() returns the state kept for the file being written, starting it  */
+/* if this is the first write to it.                                          */
+
+static ASYNC_FILE *getFile(int fd)
+{
+	if ((current != NULL) && (current->fd == fd))
+		return(current);
+
+	if ((current != NULL) && (current->buffer != NULL))
+		submitWrite(current);
+
+	current = (ASYNC_FILE*) calloc(1, sizeof(ASYNC_FILE));
+	if (current == NULL)
+	{
+		fprintf(stderr, "Memory error while writing file!\n");
+		return(NULL);
+	}
+
+	current->type = ASYNC_CLOSE;
+	current->fd = fd;
+
+	return(current);
+}
+
+
+/* getBuffer() takes an output buffer from the pool, waiting for a write to   */
+/* complete if they are all in use.                                           */
+
+static OUT_BUFFER *getBuffer(void)
+{
+	OUT_BUFFER *buffer;
+
+	while (freeBuffers == NULL)
+	{
+		if (reapAsync(1) != 0)
+			return(NULL);
+	}
+
+	buffer = freeBuffers;
+	freeBuffers = buffer->next;
+
+	return(buffer);
+}
+
+
+/* submitWrite() submits the file's current output buffer.                    */
+
+static INT32 submitWrite(ASYNC_FILE *file)
+{
+	struct io_uring_sqe *sqe;
+	OUT_BUFFER *buffer;
+
+	buffer = file->buffer;
+	file->buffer = NULL;
+
+	sqe = getSqe();
+	if (sqe == NULL)
+		return(-1);
+
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = file->fd;
+	sqe->addr = (unsigned long) buffer->data;
+	sqe->len = (unsigned) buffer->length;
+	sqe->off = (__u64) buffer->offset;
+	sqe->user_data = (unsigned long) buffer;
+
+	file->pending += 1;
+
+	return(submitAsync(0));
+}
+
+
+/* finishFile() sets the times of a file whose writes have all completed and  */
+/* submits its close. io_uring has no operations for file times, so they are  */
+/* set with futimens(), which is cheap on an open descriptor.                 */
+
+static void finishFile(ASYNC_FILE *file)
+{
+	struct io_uring_sqe *sqe;
+
+	if (futimens(file->fd, file->times) != 0)
+		fprintf(stderr, "Error %d setting modification/access time of %s!\n",
+		        errno, file->path);
+
+	sqe = getSqe();
+	if (sqe == NULL)
+	{
+		close(file->fd);
+		free(file->path);
+		free(file);
+		return;
+	}
+
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = file->fd;
+	sqe->user_data = (unsigned long) file;
+
+	return;
+}
+
+
+#else
+
+
+INT32 startAsync(void)
+{
+	fprintf(stderr, "mtf was built without io_uring support (-A)!\n");
+
+	return(-1);
+}
+
+
+INT32 stopAsync(void)
+{
+	return(0);
+}
+
+
+INT32 startAsyncReads(size_t length, UINT16 slots)
+{
+	return(-1);
+}
+
+
+ssize_t readAsync(UINT8 *buffer, size_t size)
+{
+	errno = ENOSYS;
+
+	return(-1);
+}
+
+
+void stopAsyncReads(void)
+{
+	return;
+}
+
+
+INT32 asyncWrite(int fd, UINT8 *data, size_t length)
+{
+	return(-1);
+}
+
+
+INT32 asyncSeek(int fd, off_t offset)
+{
+	return(-1);
+}
+
+
+INT32 asyncClose(int fd, char *path, struct utimbuf *times)
+{
+	return(-1);
+}
+
+
+#endif
@@ -35,16 +35,51 @@ See mtf.c for version history, contributors, etc.
 */
 
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/param.h>
 #include <sys/fcntl.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <utime.h>
+#include <time.h>
+#include <pthread.h>
 #include "mtf.h"
 
 
-extern UINT16 remaining;
-extern UINT8 *tBuffer;
+extern UINT32 remaining;
+extern UINT8 *tData;
+
+
+typedef struct DIR_ENTRY
+{
+	struct DIR_ENTRY	*next;		/* chain */
+	UINT32				hash;		/* hash of path */
+	char				path[1];	/* path, allocated to length */
+} DIR_ENTRY;
+
+
+typedef struct
+{
+	char	*path;		/* directory, NULL if the slot is free */
+	int		fd;			/* descriptor open on it */
+	UINT32	refs;		/* number of holders */
+	UINT32	used;		/* when it was last opened */
+} DIR_FD;
+
+
+static DIR_ENTRY **dirTable = NULL;
+static UINT32 dirSlots = 0, dirCount = 0;
+static DIR_FD dirFds[DIR_FDS];
+static UINT32 dirTick = 0;
+static pthread_mutex_t dirLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static UINT32 hashPath(char*);
 
 
 /* strlwr() lowercases a string.                                              */
@@ -124,6 +159,65 @@ void decrement64(UINT64 *big, UINT32 dec)
 }
 
 
+/* headerSum() returns the checksum MTF keeps in block and stream headers,    */
+/* the exclusive-or of the 16-bit words preceding it.                         */
+
+UINT16 headerSum(void *hdr, size_t bytes)
+{
+	UINT16 sum, word;
+	UINT8 *ptr;
+	size_t i;
+
+	sum = 0;
+	ptr = (UINT8*) hdr;
+
+	for (i = 0; i + 1 < bytes; i += 2)
+	{
+		memcpy(&word, &ptr[i], sizeof(word));
+		sum ^= word;
+	}
+
+	return(sum);
+}
+
+
+/* xorWords() returns the exclusive-or of data taken as little-endian 32-bit  */
+/* words, the last one padded with zeros. The words are combined eight bytes  */
+/* at a time into independent accumulators, a loop the compiler vectorizes.   */
+
+UINT32 xorWords(UINT8 *data, size_t bytes)
+{
+	unsigned long long acc[4], word;
+	UINT32 sum;
+	size_t i, j;
+
+	acc[0] = acc[1] = acc[2] = acc[3] = 0;
+
+	for (i = 0; i + 32 <= bytes; i += 32)
+	{
+		for (j = 0; j < 4; j += 1)
+		{
+			memcpy(&word, &data[i + j * 8], sizeof(word));
+			acc[j] ^= word;
+		}
+	}
+
+	for (; i + 8 <= bytes; i += 8)
+	{
+		memcpy(&word, &data[i], sizeof(word));
+		acc[0] ^= word;
+	}
+
+	word = acc[0] ^ acc[1] ^ acc[2] ^ acc[3];
+	sum = (UINT32) ((word ^ (word >> 32)) & 0xFFFFFFFFUL);
+
+	for (; i < bytes; i += 1)
+		sum ^= (UINT32) data[i] << ((i % 4) * 8);
+
+	return(sum);
+}
+
+
 void dump(char *name)
 {
 	int handle;
@@ -131,9 +225,263 @@ void dump(char *name)
 	handle = open(name, O_WRONLY | O_TRUNC | O_CREAT);
 	if (handle != -1)
 	{
-		write(handle, tBuffer, remaining);
+		write(handle, tData, remaining);
 		close(handle);
 	}
 
 	return;
 }
+
+
+/* knownDir() returns 1 if a directory has already been found or created by  */
+/* addDir(), or 0 if it must still be tested for.                            */
+
+INT32 knownDir(char *path)
+{
+	UINT32 hash;
+	DIR_ENTRY *entry;
+
+	if (dirCount == 0)
+		return(0);
+
+	hash = hashPath(path);
+
+	for (entry = dirTable[hash % dirSlots]; entry != NULL; entry = entry->next)
+	{
+		if ((entry->hash == hash) && (strcmp(entry->path, path) == 0))
+			return(1);
+	}
+
+	return(0);
+}
+
+
+/* addDir() records a directory that exists, so that it is not tested for or */
+/* created again. The table is doubled whenever it averages one entry per     */
+/* slot.                                                                      */
+
+INT32 addDir(char *path)
+{
+	UINT32 i, slots;
+	DIR_ENTRY *entry, *next, **table;
+
+	if (knownDir(path) != 0)
+		return(0);
+
+	if (dirCount >= dirSlots)
+	{
+		slots = (dirSlots == 0) ? DIR_CACHE_SLOTS : dirSlots * 2;
+
+		table = (DIR_ENTRY**) calloc(slots, sizeof(DIR_ENTRY*));
+		if (table == NULL)
+		{
+			fprintf(stderr, "Memory error while caching directories!\n");
+			return(-1);
+		}
+
+		for (i = 0; i < dirSlots; i += 1)
+		{
+			for (entry = dirTable[i]; entry != NULL; entry = next)
+			{
+				next = entry->next;
+				entry->next = table[entry->hash % slots];
+				table[entry->hash % slots] = entry;
+			}
+		}
+
+		free(dirTable);
+		dirTable = table;
+		dirSlots = slots;
+	}
+
+	entry = (DIR_ENTRY*) malloc(sizeof(DIR_ENTRY) + strlen(path));
+	if (entry == NULL)
+	{
+		fprintf(stderr, "Memory error while caching directories!\n");
+		return(-1);
+	}
+
+	strcpy(entry->path, path);
+	entry->hash = hashPath(path);
+	entry->next = dirTable[entry->hash % dirSlots];
+	dirTable[entry->hash % dirSlots] = entry;
+	dirCount += 1;
+
+	return(0);
+}
+
+
+/* hashPath() computes the FNV-1a hash of a path.                             */
+
+static UINT32 hashPath(char *path)
+{
+	UINT32 hash;
+
+	hash = 2166136261UL;
+
+	while (*path != '\0')
+	{
+		hash ^= (UINT8) *path;
+		hash *= 16777619UL;
+		hash &= 0xFFFFFFFFUL;
+
+		path += 1;
+	}
+
+	return(hash);
+}
+
+
+/* openDir() returns a descriptor open on a directory, for creating files     */
+/* relative to it with openat(). The last DIR_FDS directories opened are kept */
+/* open, so a directory that is returned to is not looked up again. Each      */
+/* descriptor returned must be given back with closeDir().                    */
+
+int openDir(char *path)
+{
+	int i, victim, fd;
+
+	pthread_mutex_lock(&dirLock);
+
+	victim = -1;
+
+	for (i = 0; i < DIR_FDS; i += 1)
+	{
+		if ((dirFds[i].path != NULL) && (strcmp(dirFds[i].path, path) == 0))
+		{
+			dirFds[i].refs += 1;
+			dirTick += 1;
+			dirFds[i].used = dirTick;
+			fd = dirFds[i].fd;
+
+			pthread_mutex_unlock(&dirLock);
+			return(fd);
+		}
+
+		if (dirFds[i].refs != 0)
+			continue;
+
+		if ((victim == -1) || (dirFds[i].path == NULL) ||
+		    ((dirFds[victim].path != NULL) &&
+		     (dirFds[i].used < dirFds[victim].used)))
+			victim = i;
+	}
+
+	fd = open(path, O_RDONLY | O_DIRECTORY);
+
+	if ((fd != -1) && (victim != -1))
+	{
+		if (dirFds[victim].path != NULL)
+		{
+			close(dirFds[victim].fd);
+			free(dirFds[victim].path);
+		}
+
+		dirFds[victim].path = strdup(path);
+		if (dirFds[victim].path != NULL)
+		{
+			dirFds[victim].fd = fd;
+			dirFds[victim].refs = 1;
+			dirTick += 1;
+			dirFds[victim].used = dirTick;
+		}
+	}
+
+	pthread_mutex_unlock(&dirLock);
+
+	return(fd);
+}
+
+
+/* holdDir() takes another hold on a descriptor returned by openDir(). It     */
+/* returns the descriptor to use, which must also be given to closeDir().     */
+
+int holdDir(int fd)
+{
+	int i;
+
+	pthread_mutex_lock(&dirLock);
+
+	for (i = 0; i < DIR_FDS; i += 1)
+	{
+		if ((dirFds[i].path != NULL) && (dirFds[i].fd == fd))
+		{
+			dirFds[i].refs += 1;
+
+			pthread_mutex_unlock(&dirLock);
+			return(fd);
+		}
+	}
+
+	pthread_mutex_unlock(&dirLock);
+
+	return(dup(fd));
+}
+
+
+/* closeDir() gives back a descriptor returned by openDir() or holdDir(). A   */
+/* directory that is kept open stays open until it is the least recently      */
+/* used one and its slot is needed.                                           */
+
+void closeDir(int fd)
+{
+	int i;
+
+	if (fd == -1)
+		return;
+
+	pthread_mutex_lock(&dirLock);
+
+	for (i = 0; i < DIR_FDS; i += 1)
+	{
+		if ((dirFds[i].path != NULL) && (dirFds[i].fd == fd))
+		{
+			dirFds[i].refs -= 1;
+
+			pthread_mutex_unlock(&dirLock);
+			return;
+		}
+	}
+
+	pthread_mutex_unlock(&dirLock);
+
+	close(fd);
+
+	return;
+}
+
+
+/* setTimes() sets the access and modification times of a file relative to a */
+/* directory descriptor.                                                      */
+
+INT32 setTimes(int dir, char *name, struct utimbuf *times)
+{
+	struct timespec ts[2];
+
+	ts[0].tv_sec = times->actime;
+	ts[0].tv_nsec = 0;
+	ts[1].tv_sec = times->modtime;
+	ts[1].tv_nsec = 0;
+
+	return(utimensat(dir, name, ts, 0));
+}
+
+
+/* getTime() converts an MTF date to local time.                              */
+
+time_t getTime(UINT8 *date)
+{
+	struct tm tbuf;
+
+	memset(&tbuf, 0, sizeof(tbuf));
+
+	tbuf.tm_sec = MTF_SECOND(date);
+	tbuf.tm_min = MTF_MINUTE(date);
+	tbuf.tm_hour = MTF_HOUR(date);
+	tbuf.tm_mday = MTF_DAY(date);
+	tbuf.tm_mon = MTF_MONTH(date) - 1;
+	tbuf.tm_year = MTF_YEAR(date) - 1900;
+	tbuf.tm_isdst = -1;
+
+	return(mktime(&tbuf));
+}